@@ -0,0 +1,88 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+extern "C" {
+#include <GL/glew.h>
+}
+
+#include "lighting.h"
+#include "perspectivecamera.h"
+#include "shader.h"
+
+// Froxel grid the view frustum is split into for clustered shading. The tiles
+// follow the screen, the slices are spaced exponentially in depth so froxels
+// far away don't end up as long slivers.
+const GLuint kClusterX = 16;
+const GLuint kClusterY = 9;
+const GLuint kClusterZ = 24;
+const GLuint kClusterCount = kClusterX * kClusterY * kClusterZ;
+
+// Point lights handed to the shaders through texture buffers. The lights can
+// also be binned into the froxels they reach, so every fragment only loops
+// over the lights of its own froxel instead of all of them, or listed per
+// object so every draw only loops over the lights reaching that object.
+class LightClusters {
+  public:
+    LightClusters();
+    ~LightClusters();
+
+    LightClusters(const LightClusters&) = delete;
+    LightClusters& operator=(const LightClusters&) = delete;
+
+    // Uploads the lights and, when clustered is set, bins them for the camera
+    // with one slice of the grid per worker task.
+    void update(const std::vector<PointLight>& lights,
+        const PerspectiveCamera& camera, bool clustered);
+
+    // Lists the lights reaching each of the given bounding spheres (center and
+    // radius) in place of binning them, after an update that wasn't
+    // clustered.
+    void listObjects(const std::vector<PointLight>& lights,
+        const std::vector<glm::vec4>& objects);
+
+    // Binds the light buffers to the three texture units starting at
+    // firstUnit and passes the grid layout to the shader, which must be in
+    // use. width and height are the size of the framebuffer drawn to.
+    void bind(const Shader& shader, GLuint firstUnit, GLuint width,
+        GLuint height);
+
+    // Picks the light list of one of the listed objects for the next draw.
+    // The shader must be in use and bound.
+    void bindObject(const Shader& shader, GLuint object);
+
+    // Light indices stored by the last clustered update or object listing,
+    // the most any single froxel or object got and the CPU time spent
+    // binning or listing.
+    size_t indexCount;
+    GLuint maxClusterLights;
+    double binMilliseconds;
+  private:
+    // Light data, froxel ranges (offset and count into the indices) and light
+    // indices, and the buffer textures the shaders read them through.
+    GLuint buffers[3];
+    GLuint textures[3];
+
+    std::vector<GLuint> grid;
+    std::vector<GLuint> indices;
+
+    // Offset and count into the indices of every listed object.
+    std::vector<GLint> objectRanges;
+
+    // Lights reaching each froxel, filled by the workers.
+    std::vector<std::vector<GLuint>> clusterLights;
+
+    GLuint lightCount;
+    bool clustered;
+    bool listed;
+    GLfloat near;
+    GLfloat far;
+
+    void bin(const std::vector<PointLight>& lights,
+        const PerspectiveCamera& camera);
+};
+
+#endif
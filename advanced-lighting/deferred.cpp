@@ -0,0 +1,298 @@
+#include "deferred.h"
+
+#include <math.h>
+
+#include <glm/gtc/type_ptr.hpp>
+
+namespace {
+
+const GLfloat kPi = 3.14159265f;
+
+// Segments of the light sphere around its axis and from pole to pole.
+const GLuint kSphereSlices = 16;
+const GLuint kSphereStacks = 12;
+
+// Whether a sphere lies entirely behind one of the six frustum planes, which
+// are taken from the rows of the view projection matrix.
+bool outsideFrustum(const glm::mat4& viewProjection, glm::vec3 center,
+    GLfloat radius) {
+  glm::vec4 rows[4];
+  for (GLuint i = 0; i < 4; i++) {
+    rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i],
+        viewProjection[2][i], viewProjection[3][i]);
+  }
+
+  for (GLuint i = 0; i < 6; i++) {
+    glm::vec4 plane = i % 2 == 0 ? rows[3] + rows[i / 2] :
+      rows[3] - rows[i / 2];
+    glm::vec3 normal(plane.x, plane.y, plane.z);
+    if (glm::dot(normal, center) + plane.w < -radius * glm::length(normal)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+}
+
+DeferredRenderer::DeferredRenderer(GLuint width, GLuint height,
+    GLuint samples) :
+    lightShader("glsl/deferred_vert.glsl", "glsl/deferred_frag.glsl"),
+    width(width), height(height), samples(samples),
+    volumeShader("glsl/deferred_vert.glsl", "glsl/volume_frag.glsl"),
+    edgeShader("glsl/deferred_vert.glsl", "glsl/edge_frag.glsl") {
+  glGenFramebuffers(2, this->framebuffers);
+  glGenTextures(4, this->textures);
+
+  // Every G-buffer target has to match the sample count of the framebuffer
+  // the depth gets copied to.
+  const GLenum formats[3] = { GL_SRGB8_ALPHA8, GL_RG16, GL_DEPTH24_STENCIL8 };
+  const GLenum attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1,
+    GL_DEPTH_STENCIL_ATTACHMENT };
+  glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffers[0]);
+  for (GLuint i = 0; i < 3; i++) {
+    glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, this->textures[i]);
+    glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, samples, formats[i],
+        width, height, GL_TRUE);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, attachments[i],
+        GL_TEXTURE_2D_MULTISAMPLE, this->textures[i], 0);
+  }
+
+  // The implementation may round the sample count up, the shaders loop over
+  // what it actually allocated.
+  GLint allocated;
+  glGetTexLevelParameteriv(GL_TEXTURE_2D_MULTISAMPLE, 0, GL_TEXTURE_SAMPLES,
+      &allocated);
+  this->samples = allocated;
+  glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+
+  const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+  glDrawBuffers(2, drawBuffers);
+
+  // One byte per pixel is plenty for the edge mask.
+  glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffers[1]);
+  glBindTexture(GL_TEXTURE_2D, this->textures[3]);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED,
+      GL_UNSIGNED_BYTE, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+      this->textures[3], 0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  createSphere();
+}
+
+DeferredRenderer::~DeferredRenderer() {
+  glDeleteVertexArrays(1, &this->vao);
+  glDeleteBuffers(2, this->buffers);
+  glDeleteFramebuffers(2, this->framebuffers);
+  glDeleteTextures(4, this->textures);
+}
+
+bool DeferredRenderer::complete() {
+  bool complete = true;
+  for (GLuint i = 0; i < 2; i++) {
+    glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffers[i]);
+    complete = complete &&
+      glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  return complete;
+}
+
+void DeferredRenderer::beginGeometry() {
+  glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffers[0]);
+  glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+  glEnable(GL_DEPTH_TEST);
+}
+
+void DeferredRenderer::light(GLuint target, const PerspectiveCamera& camera,
+    const std::vector<PointLight>& lights, LightClusters& clusters,
+    GLuint firstUnit) {
+  const glm::mat4 viewProjection = camera.projection * camera.view;
+  const glm::mat4 inverseViewProjection = glm::inverse(viewProjection);
+
+  // Copy the scene depth over for the light volumes to be tested against. The
+  // G-buffer depth is sampled meanwhile, so it can't be attached itself.
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, this->framebuffers[0]);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+  glBlitFramebuffer(0, 0, this->width, this->height, 0, 0, this->width,
+      this->height, GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+
+  // The G-buffer goes on the first three units and the edge mask after it,
+  // the light buffers follow.
+  for (GLuint i = 0; i < 3; i++) {
+    glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+    glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, this->textures[i]);
+  }
+  glActiveTexture(GL_TEXTURE0 + firstUnit + 3);
+  glBindTexture(GL_TEXTURE_2D, this->textures[3]);
+
+  glBindVertexArray(this->vao);
+  glDisable(GL_DEPTH_TEST);
+
+  // Find the pixels whose samples don't all see the same surface. Only those
+  // are shaded once per sample, the rest once per pixel.
+  glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffers[1]);
+  this->edgeShader.use();
+  setGBufferUniforms(this->edgeShader, firstUnit, inverseViewProjection);
+  glUniform1i(glGetUniformLocation(this->edgeShader.program, "directional"),
+      GL_TRUE);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+
+  // The directional light and the background cover the whole screen, which
+  // also overwrites whatever the target held.
+  glBindFramebuffer(GL_FRAMEBUFFER, target);
+  this->lightShader.use();
+  setGBufferUniforms(this->lightShader, firstUnit, inverseViewProjection);
+  clusters.bind(this->lightShader, firstUnit + 4, this->width, this->height);
+  GLint directional = glGetUniformLocation(this->lightShader.program,
+      "directional");
+  GLint lightIndex = glGetUniformLocation(this->lightShader.program,
+      "lightIndex");
+  glUniformMatrix4fv(glGetUniformLocation(this->lightShader.program,
+        "viewProjection"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+  glUniform1i(directional, GL_TRUE);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+  glUniform1i(directional, GL_FALSE);
+
+  this->volumeShader.use();
+  clusters.bind(this->volumeShader, firstUnit + 4, this->width, this->height);
+  GLint volumeIndex = glGetUniformLocation(this->volumeShader.program,
+      "lightIndex");
+  glUniformMatrix4fv(glGetUniformLocation(this->volumeShader.program,
+        "viewProjection"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+
+  // Depth clamping keeps the back of spheres reaching past the far plane
+  // from being clipped away. Point lights add up.
+  glEnable(GL_STENCIL_TEST);
+  glEnable(GL_DEPTH_CLAMP);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_ONE, GL_ONE);
+  glDepthMask(GL_FALSE);
+
+  GLsizei indices = this->sphereIndexCount;
+  GLvoid* offset = (GLvoid*)0;
+  for (GLuint i = 0; i < lights.size(); i++) {
+    if (outsideFrustum(viewProjection, lights[i].position, lights[i].radius)) {
+      continue;
+    }
+
+    // Stencil pass. Back faces behind the surface count up and front faces
+    // behind it count down, so only pixels whose surface is inside the
+    // sphere are left non-zero. This also holds with the camera inside it.
+    this->volumeShader.use();
+    glUniform1i(volumeIndex, i);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glEnable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+    glStencilFunc(GL_ALWAYS, 0, 0xFF);
+    glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+    glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+    glDrawElements(GL_TRIANGLES, indices, GL_UNSIGNED_INT, offset);
+
+    // Lighting pass over the back faces, which still cover the sphere when
+    // the camera is inside it. The marked pixels are reset on the way so the
+    // next light starts from a clear stencil buffer.
+    this->lightShader.use();
+    glUniform1i(lightIndex, i);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_FRONT);
+    glStencilFunc(GL_NOTEQUAL, 0, 0xFF);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_ZERO);
+    glDrawElements(GL_TRIANGLES, indices, GL_UNSIGNED_INT, offset);
+  }
+
+  // Leave the state the way forward rendering expects it.
+  glDepthMask(GL_TRUE);
+  glDisable(GL_BLEND);
+  glDisable(GL_DEPTH_CLAMP);
+  glDisable(GL_STENCIL_TEST);
+  glDisable(GL_CULL_FACE);
+  glCullFace(GL_BACK);
+  glEnable(GL_DEPTH_TEST);
+  glBindVertexArray(0);
+}
+
+void DeferredRenderer::createSphere() {
+  // The flat faces cut into the sphere between the vertices, so the vertices
+  // are pushed out until the mesh contains the whole sphere.
+  const GLfloat scale = 1.0f / (cosf(kPi / kSphereSlices) *
+      cosf(kPi / (2 * kSphereStacks)));
+
+  // Full screen triangle in NDC first.
+  std::vector<GLfloat> vertices = {
+    -1.0f, -1.0f, 0.0f,
+     3.0f, -1.0f, 0.0f,
+    -1.0f,  3.0f, 0.0f
+  };
+  for (GLuint i = 0; i <= kSphereStacks; i++) {
+    GLfloat theta = kPi * i / kSphereStacks;
+    for (GLuint j = 0; j < kSphereSlices; j++) {
+      GLfloat phi = 2.0f * kPi * j / kSphereSlices;
+      vertices.push_back(scale * sinf(theta) * cosf(phi));
+      vertices.push_back(scale * cosf(theta));
+      vertices.push_back(scale * sinf(theta) * sinf(phi));
+    }
+  }
+
+  // Quads between neighbouring stacks wound counter-clockwise seen from
+  // outside, minus the triangles that collapse at the poles.
+  std::vector<GLuint> indices;
+  for (GLuint i = 0; i < kSphereStacks; i++) {
+    for (GLuint j = 0; j < kSphereSlices; j++) {
+      GLuint next = (j + 1) % kSphereSlices;
+      GLuint a = 3 + i * kSphereSlices + j;
+      GLuint b = 3 + (i + 1) * kSphereSlices + j;
+      GLuint c = 3 + (i + 1) * kSphereSlices + next;
+      GLuint d = 3 + i * kSphereSlices + next;
+      if (i != kSphereStacks - 1) {
+        indices.insert(indices.end(), { a, c, b });
+      }
+      if (i != 0) {
+        indices.insert(indices.end(), { a, d, c });
+      }
+    }
+  }
+  this->sphereIndexCount = indices.size();
+
+  glGenVertexArrays(1, &this->vao);
+  glGenBuffers(2, this->buffers);
+
+  glBindVertexArray(this->vao);
+  glBindBuffer(GL_ARRAY_BUFFER, this->buffers[0]);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat),
+      vertices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->buffers[1]);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint),
+      indices.data(), GL_STATIC_DRAW);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat),
+      (GLvoid*)0);
+  glEnableVertexAttribArray(0);
+  glBindVertexArray(0);
+}
+
+void DeferredRenderer::setGBufferUniforms(const Shader& shader,
+    GLuint firstUnit, const glm::mat4& inverseViewProjection) {
+  const char* samplers[4] = { "gAlbedoSpecular", "gNormal", "gDepth",
+    "edges" };
+  for (GLuint i = 0; i < 4; i++) {
+    glUniform1i(glGetUniformLocation(shader.program, samplers[i]),
+        firstUnit + i);
+  }
+
+  glUniform1i(glGetUniformLocation(shader.program, "gSamples"),
+      this->samples);
+  glUniformMatrix4fv(glGetUniformLocation(shader.program,
+        "inverseViewProjection"), 1, GL_FALSE,
+      glm::value_ptr(inverseViewProjection));
+  glUniform2f(glGetUniformLocation(shader.program, "screenSize"),
+      (GLfloat)this->width, (GLfloat)this->height);
+}
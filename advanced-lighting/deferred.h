@@ -0,0 +1,80 @@
+#ifndef DEFERRED_H
+#define DEFERRED_H
+
+#include <vector>
+
+extern "C" {
+#include <GL/glew.h>
+}
+
+#include "cluster.h"
+#include "lighting.h"
+#include "perspectivecamera.h"
+#include "shader.h"
+
+// Deferred shading through a multisampled G-buffer. The scene is drawn into it
+// once, 12 bytes per sample:
+//
+//   0: albedo in sRGB and specular intensity (SRGB8_ALPHA8)
+//   1: octahedral encoded normal (RG16)
+//   depth and stencil (DEPTH24_STENCIL8), positions are rebuilt from depth
+//
+// Every point light is then drawn as a sphere bounding its radius. A stencil
+// pass first marks the pixels whose surface lies inside the sphere, so the
+// lighting pass only shades the pixels the light can reach.
+class DeferredRenderer {
+  public:
+    // Allocates a G-buffer of the given size with as many samples as the
+    // framebuffer it gets lit into.
+    DeferredRenderer(GLuint width, GLuint height, GLuint samples);
+    ~DeferredRenderer();
+
+    DeferredRenderer(const DeferredRenderer&) = delete;
+    DeferredRenderer& operator=(const DeferredRenderer&) = delete;
+
+    // Whether the G-buffer could be created with these formats.
+    bool complete();
+
+    // Binds and clears the G-buffer for the geometry pass. The scene is then
+    // drawn with a shader writing the outputs of glsl/gbuffer_frag.glsl.
+    void beginGeometry();
+
+    // Lights the G-buffer into target, which needs a depth and stencil
+    // attachment of the same size and sample count. The scene depth is copied
+    // into it so forward geometry can be drawn on top afterwards. The point
+    // lights are read from the buffers of clusters, which must have been
+    // updated with lights, and are bound to the units after the G-buffer ones.
+    // The dirLight, viewPos, shininess and background uniforms of lightShader
+    // have to be set beforehand.
+    void light(GLuint target, const PerspectiveCamera& camera,
+        const std::vector<PointLight>& lights, LightClusters& clusters,
+        GLuint firstUnit);
+
+    // Shades the directional light over the whole screen and each light
+    // volume.
+    Shader lightShader;
+  private:
+    GLuint width;
+    GLuint height;
+    GLuint samples;
+
+    // The G-buffer and the single sampled mask of the pixels that are shaded
+    // per sample, and the textures behind them (albedo and specular, normal,
+    // depth and stencil, mask).
+    GLuint framebuffers[2];
+    GLuint textures[4];
+
+    Shader volumeShader;
+    Shader edgeShader;
+
+    // A full screen triangle followed by the light sphere.
+    GLuint vao;
+    GLuint buffers[2];
+    GLsizei sphereIndexCount;
+
+    void createSphere();
+    void setGBufferUniforms(const Shader& shader, GLuint firstUnit,
+        const glm::mat4& inverseViewProjection);
+};
+
+#endif
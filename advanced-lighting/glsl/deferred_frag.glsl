@@ -0,0 +1,57 @@
+#version 330 core
+
+#define BLINN_PHONG
+#include "clusters.glsl"
+#include "gbuffer.glsl"
+
+out vec4 color;
+
+// Single sampled mask of the pixels to shade per sample.
+uniform sampler2D edges;
+
+// Either the directional light over the whole screen, or the point light at
+// lightIndex in the light buffer.
+uniform bool directional;
+uniform int lightIndex;
+uniform DirectionalLight dirLight;
+
+uniform vec3 viewPos;
+uniform float shininess;
+uniform vec3 background; // Where no geometry was drawn.
+
+void main() {
+  ivec2 texel = ivec2(gl_FragCoord.xy);
+  int count = texelFetch(edges, texel, 0).r > 0.5f ? gSamples : 1;
+
+  PointLight light;
+  if (!directional) {
+    light = fetchPointLight(lightIndex);
+  }
+
+  // Average the samples the light reaches. Those are the samples the stencil
+  // test lets through, so each of them ends up with its share of the light
+  // once resolved.
+  vec3 result = vec3(0.0f);
+  int reached = 0;
+  for (int i = 0; i < count; i++) {
+    float depth = texelFetch(gDepth, texel, i).r;
+    if (depth == 1.0f) {
+      if (directional) {
+        result += background;
+        reached++;
+      }
+      continue;
+    }
+
+    Surface surface = fetchSurface(texel, i, depth, viewPos, shininess);
+    if (directional) {
+      result += calcDirectionalLight(dirLight, surface);
+      reached++;
+    } else if (distance(light.position, surface.position) < light.radius) {
+      result += calcPointLight(light, surface);
+      reached++;
+    }
+  }
+
+  color = vec4(result / float(max(reached, 1)), 1.0f);
+}
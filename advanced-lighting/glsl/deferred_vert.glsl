@@ -0,0 +1,22 @@
+#version 330 core
+
+layout (location = 0) in vec3 position;
+
+// Light buffer, four texels per light with the position and radius first.
+uniform samplerBuffer lightData;
+
+uniform bool directional; // Passes a full screen triangle through instead.
+uniform int lightIndex;
+uniform mat4 viewProjection;
+
+void main() {
+  if (directional) {
+    gl_Position = vec4(position.xy, 0.0f, 1.0f);
+    return;
+  }
+
+  // Fit the unit sphere around the light.
+  vec4 positionRadius = texelFetch(lightData, lightIndex * 4);
+  gl_Position = viewProjection *
+    vec4(positionRadius.xyz + position * positionRadius.w, 1.0f);
+}
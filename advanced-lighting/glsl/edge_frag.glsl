@@ -0,0 +1,9 @@
+#version 330 core
+
+#include "gbuffer.glsl"
+
+out float edge;
+
+void main() {
+  edge = edgePixel(ivec2(gl_FragCoord.xy)) ? 1.0f : 0.0f;
+}
@@ -0,0 +1,89 @@
+#ifndef GBUFFER_GLSL
+#define GBUFFER_GLSL
+
+#include "lighting.glsl"
+
+// Reading back the G-buffer written by gbuffer_frag.glsl, see deferred.h for
+// its layout.
+
+// Samples of a pixel are taken to see the same surface when their distances
+// to the camera differ by less than this fraction and their normals by less
+// than this cosine.
+#define EDGE_DEPTH 0.01f
+#define EDGE_NORMAL 0.99f
+
+uniform sampler2DMS gAlbedoSpecular;
+uniform sampler2DMS gNormal;
+uniform sampler2DMS gDepth;
+uniform int gSamples;
+
+uniform mat4 inverseViewProjection;
+uniform vec2 screenSize;
+
+// Folds the lower half of the octahedron over the upper one.
+vec2 octahedronWrap(vec2 v) {
+  return (1.0f - abs(v.yx)) *
+    vec2(v.x >= 0.0f ? 1.0f : -1.0f, v.y >= 0.0f ? 1.0f : -1.0f);
+}
+
+// Unit normals are stored as a point on an octahedron unfolded into a square,
+// which keeps them accurate to a fraction of a degree in two 16-bit channels.
+vec2 encodeNormal(vec3 normal) {
+  normal /= abs(normal.x) + abs(normal.y) + abs(normal.z);
+  vec2 encoded = normal.z >= 0.0f ? normal.xy : octahedronWrap(normal.xy);
+  return encoded * 0.5f + 0.5f;
+}
+
+vec3 decodeNormal(vec2 encoded) {
+  encoded = encoded * 2.0f - 1.0f;
+  vec3 normal = vec3(encoded, 1.0f - abs(encoded.x) - abs(encoded.y));
+  if (normal.z < 0.0f) {
+    normal.xy = octahedronWrap(normal.xy);
+  }
+  return normalize(normal);
+}
+
+// World space position of a depth buffer value at the given pixel, before the
+// divide. Its w is one over the distance along the view direction.
+vec4 unproject(ivec2 texel, float depth) {
+  vec2 ndc = (vec2(texel) + 0.5f) / screenSize * 2.0f - 1.0f;
+  return inverseViewProjection * vec4(ndc, depth * 2.0f - 1.0f, 1.0f);
+}
+
+// Whether the samples of a pixel don't all belong to the same surface, as is
+// the case along the edges of triangles.
+bool edgePixel(ivec2 texel) {
+  float depth = 1.0f / unproject(texel, texelFetch(gDepth, texel, 0).r).w;
+  vec3 normal = decodeNormal(texelFetch(gNormal, texel, 0).rg);
+
+  for (int i = 1; i < gSamples; i++) {
+    float sampleDepth =
+      1.0f / unproject(texel, texelFetch(gDepth, texel, i).r).w;
+    vec3 sampleNormal = decodeNormal(texelFetch(gNormal, texel, i).rg);
+    if (abs(sampleDepth - depth) > EDGE_DEPTH * depth ||
+        dot(sampleNormal, normal) < EDGE_NORMAL) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Rebuilds the surface seen by one sample of a pixel from the G-buffer.
+Surface fetchSurface(ivec2 texel, int sampleIndex, float depth,
+    vec3 viewPos, float shininess) {
+  vec4 position = unproject(texel, depth);
+  vec4 albedoSpecular = texelFetch(gAlbedoSpecular, texel, sampleIndex);
+
+  Surface surface;
+  surface.position = position.xyz / position.w;
+  surface.normal = decodeNormal(texelFetch(gNormal, texel, sampleIndex).rg);
+  surface.viewDir = normalize(viewPos - surface.position);
+  surface.albedo = albedoSpecular.rgb;
+  surface.specular = vec3(albedoSpecular.a);
+  surface.emission = vec3(0.0f);
+  surface.shininess = shininess;
+  return surface;
+}
+
+#endif
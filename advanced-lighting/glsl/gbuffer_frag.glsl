@@ -0,0 +1,29 @@
+#version 330 core
+
+#include "gbuffer.glsl"
+
+struct Material {
+  sampler2D diffuse;
+  sampler2D specular;
+};
+
+// Interpolated mesh data.
+in GS_OUT {
+  vec3 position;
+  vec3 normal;
+  vec2 uv;
+} frag_in;
+
+layout (location = 0) out vec4 albedoSpecular;
+layout (location = 1) out vec2 normal;
+
+// Material chosen for the object.
+uniform Material material;
+
+void main() {
+  // The specular map is grey, only its intensity is kept.
+  vec3 specular = texture(material.specular, frag_in.uv).rgb;
+  albedoSpecular = vec4(texture(material.diffuse, frag_in.uv).rgb,
+    dot(specular, vec3(0.2126f, 0.7152f, 0.0722f)));
+  normal = encodeNormal(normalize(frag_in.normal));
+}
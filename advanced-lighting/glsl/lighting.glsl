@@ -0,0 +1,131 @@
+#ifndef LIGHTING_GLSL
+#define LIGHTING_GLSL
+
+// Lighting shared by the fragment shaders, pasted in by Shader::readShader.
+// Define BLINN_PHONG before including it to use the Blinn-Phong specular term
+// instead of the Phong one.
+
+#define PI 3.14159265
+
+struct DirectionalLight {
+  vec3 direction;
+  vec3 ambient;
+  vec3 diffuse;
+  vec3 specular;
+};
+struct PointLight {
+  vec3 position;
+  vec3 ambient;
+  vec3 diffuse;
+  vec3 specular;
+  float constant;
+  float linear;
+  float quadratic;
+  float radius; // Distance past which the light contributes nothing.
+};
+struct SpotLight {
+  vec3 position;
+  vec3 direction;
+  vec3 ambient;
+  vec3 diffuse;
+  vec3 specular;
+  float constant;
+  float linear;
+  float quadratic;
+  float radius;
+  float cutoff;
+  float outerCutoff;
+};
+
+// Everything the lights need to know about a fragment. The material maps are
+// sampled once into it and then shared between all the lights.
+struct Surface {
+  vec3 position;
+  vec3 normal;  // Normalized.
+  vec3 viewDir; // Normalized, pointing from the fragment to the viewer.
+  vec3 albedo;
+  vec3 specular;
+  vec3 emission;
+  float shininess;
+};
+
+float specularTerm(Surface surface, vec3 lightDir) {
+#ifdef BLINN_PHONG
+  // Find energy conservation multiplier so shininess values for phong materials
+  // have a similar brightness for blinn-phong shininess.
+  float energyConservation = (8.0f + surface.shininess) / (8.0f * PI);
+  vec3 halfwayDir = normalize(lightDir + surface.viewDir);
+  return energyConservation *
+    pow(max(dot(surface.normal, halfwayDir), 0.0f), surface.shininess);
+#else
+  vec3 reflectDir = reflect(-lightDir, surface.normal);
+  return pow(max(dot(surface.viewDir, reflectDir), 0.0f), surface.shininess);
+#endif
+}
+
+// Light intensity falloff over distance. The curve is windowed so it reaches
+// zero at the radius instead of being cut off there with a visible edge.
+float attenuate(float constant, float linear, float quadratic, float radius,
+    float lightDistance) {
+  float attenuation = 1.0f / (constant + linear * lightDistance +
+    quadratic * (lightDistance * lightDistance));
+  float ratio = lightDistance / radius;
+  float window = clamp(1.0f - ratio * ratio * ratio * ratio, 0.0f, 1.0f);
+  return attenuation * window * window;
+}
+
+// Ambient, diffuse and specular terms of a light shining from lightDir.
+vec3 shade(vec3 ambient, vec3 diffuse, vec3 specular, Surface surface,
+    vec3 lightDir) {
+  float diff = max(dot(surface.normal, lightDir), 0.0f);
+  float spec = specularTerm(surface, lightDir);
+  return (ambient + diffuse * diff) * surface.albedo +
+    specular * (spec * surface.specular);
+}
+
+vec3 calcDirectionalLight(DirectionalLight light, Surface surface) {
+  vec3 lightDir = normalize(-light.direction);
+  return shade(light.ambient, light.diffuse, light.specular, surface,
+    lightDir);
+}
+
+vec3 calcPointLight(PointLight light, Surface surface) {
+  vec3 toLight = light.position - surface.position;
+  float lightDistance = length(toLight);
+
+  // Lights out of reach are skipped before doing any shading work.
+  if (lightDistance >= light.radius) {
+    return vec3(0.0f);
+  }
+
+  vec3 lightDir = toLight / lightDistance;
+  float attenuation = attenuate(light.constant, light.linear, light.quadratic,
+    light.radius, lightDistance);
+  return attenuation * shade(light.ambient, light.diffuse, light.specular,
+    surface, lightDir);
+}
+
+vec3 calcSpotLight(SpotLight light, Surface surface) {
+  vec3 toLight = light.position - surface.position;
+  float lightDistance = length(toLight);
+
+  if (lightDistance >= light.radius) {
+    return vec3(0.0f);
+  }
+
+  vec3 lightDir = toLight / lightDistance;
+  float attenuation = attenuate(light.constant, light.linear, light.quadratic,
+    light.radius, lightDistance);
+
+  // Soft edged cone, zero outside of the outer cutoff.
+  float theta = dot(lightDir, normalize(-light.direction));
+  float epsilon = light.cutoff - light.outerCutoff;
+  float intensity = clamp((theta - light.outerCutoff) / epsilon, 0.0f, 1.0f);
+
+  // The emission map only glows inside the cone for a lens of truth effect.
+  vec3 lit = shade(light.ambient, light.diffuse, light.specular, surface,
+    lightDir);
+  return (intensity * attenuation) * (lit + surface.emission);
+}
+
+#endif
@@ -4,9 +4,35 @@ in vec2 fragUv;
 out vec4 color;
 
 uniform sampler2D frameTexture;
+
+// Multisampled frame and its number of samples. When the count isn't zero the
+// frame is resolved here and frameTexture is left unused.
+uniform sampler2DMS frameSamples;
+uniform int frameSampleCount;
+
 uniform float time;
 
+// Averages the samples of a pixel with a luma based weight, 1 / (1 + luma)
+// as derived from Reinhard, so a single bright sample on an edge pulls the
+// pixel less towards itself than a plain average would.
+vec3 resolveSamples(ivec2 texel) {
+  vec3 sum = vec3(0.0f);
+  float weightSum = 0.0f;
+  for (int i = 0; i < frameSampleCount; i++) {
+    vec3 sample = texelFetch(frameSamples, texel, i).rgb;
+    float weight = 1.0f / (1.0f + dot(sample, vec3(0.2126f, 0.7152f, 0.0722f)));
+    sum += sample * weight;
+    weightSum += weight;
+  }
+  return sum / weightSum;
+}
+
 void main() {
-  vec3 sample = vec3(texture(frameTexture, fragUv));
+  vec3 sample;
+  if (frameSampleCount > 0) {
+    sample = resolveSamples(ivec2(gl_FragCoord.xy));
+  } else {
+    sample = vec3(texture(frameTexture, fragUv));
+  }
   color = vec4(sample, 1.0f);
 }
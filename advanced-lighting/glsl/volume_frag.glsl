@@ -0,0 +1,5 @@
+#version 330 core
+
+// Light volumes are only drawn into the stencil buffer.
+void main() {
+}
@@ -1,10 +1,14 @@
 #define UNUSED(expr) (void)(expr)
 
+#include <algorithm>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <math.h>
+#include <random>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -16,16 +20,43 @@ extern "C" {
 #include <SOIL/SOIL.h>
 }
 
+#include "cluster.h"
+#include "deferred.h"
+#include "gputimer.h"
+#include "lighting.h"
 #include "shader.h"
 #include "perspectivecamera.h"
+#include "mipmap.h"
 
 // Window constants for the initial window size.
 const GLuint kWindowWidth = 800;
 const GLuint kWindowHeight = 600;
 
+// Steps the scene through kBenchmarkMinLights to kBenchmarkMaxLights random
+// point lights, doubling the count every step, and draws each light count for
+// a while in every shading mode. The GPU time spent shading the containers and
+// the CPU time spent binning are dumped to stdout.
+const bool kBenchmarkLights = false;
+const GLuint kBenchmarkMinLights = 4;
+const GLuint kBenchmarkMaxLights = 1024;
+const GLuint kBenchmarkWarmupFrames = 10;
+const GLuint kBenchmarkFrames = 110;
+
 // Number of default samples to use with MSAA.
 const GLuint kMSAASamples = 32;
 
+// Resolve the multisampled frame in the post-processing shader rather than
+// blitting it into an intermediate texture first, which saves writing and then
+// reading back a full screen texture every frame.
+const bool kFusedResolve = true;
+
+// Filter used when generating texture mipmaps on the CPU.
+const MipFilter kMipFilter = MipFilter::Box;
+
+// Compare the CPU generated mipmaps against glGenerateMipmap when uploading
+// textures (timings and per level error are dumped to stdout).
+const bool kBenchmarkMipmaps = false;
+
 glm::mat4 model;
 glm::mat3 normal;
 
@@ -52,10 +83,31 @@ bool firstMouseEvent = true;
 // Keyboard state.
 bool keys[1024];
 
+// How the containers are lit, cycled through with C. Forward shading loops
+// over every point light per fragment, listed shading only over the lights
+// reaching the container drawn, clustered shading only over the lights binned
+// into the fragment's cluster, and deferred shading draws the lights as
+// volumes over a G-buffer.
+enum class ShadingMode {
+  Forward,
+  Listed,
+  Clustered,
+  Deferred
+};
+const GLuint kShadingModeCount = 4;
+ShadingMode shadingMode = ShadingMode::Clustered;
+
+// Sets up the scene and renders it until the window is closed, returns the
+// exit status.
+int run(GLFWwindow* window, int fbWidth, int fbHeight);
+
 // Utility functions.
-GLuint loadTexture(std::string filepath);
+GLuint loadTexture(const MipChain& chain);
 void move(GLfloat delta);
 GLfloat easeOutQuart(GLfloat t, GLfloat b, GLfloat c, GLfloat d);
+std::vector<PointLight> randomPointLights(GLuint count);
+const char* shadingModeName(ShadingMode mode);
+void setDirectionalLight(const Shader& shader);
 
 // Callbacks.
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mode);
@@ -115,16 +167,35 @@ int main() {
   // prevent overlapping polygon artifacts.
   glEnable(GL_DEPTH_TEST);
 
+  // Everything owning GL objects lives in run so it gets deleted before the
+  // context goes away with glfwTerminate.
+  int status = run(window, fbWidth, fbHeight);
+
+  // Terminate GLFW and clean any resources before exiting.
+  glfwTerminate();
+
+  return status;
+}
+
+int run(GLFWwindow* window, int fbWidth, int fbHeight) {
   // Read and compile the vertex and fragment shaders using
   // the shader helper class.
-  Shader shader("glsl/vertex.glsl", "glsl/fragment.glsl", "glsl/geometry.glsl");
+  Shader forwardShader("glsl/vertex.glsl", "glsl/fragment.glsl",
+      "glsl/geometry.glsl");
+  Shader gBufferShader("glsl/vertex.glsl", "glsl/gbuffer_frag.glsl",
+      "glsl/geometry.glsl");
   Shader lampShader("glsl/lampvertex.glsl", "glsl/lampfragment.glsl");
   Shader postShader("glsl/post_vert.glsl", "glsl/post_frag.glsl");
   Shader gsShader("glsl/gs_vert.glsl", "glsl/gs_frag.glsl", "glsl/gs_geo.glsl");
 
-  GLuint containerTexture = loadTexture("assets/container2.png");
-  GLuint containerSpecular = loadTexture("assets/container2_specular.png");
-  GLuint containerEmission = loadTexture("assets/matrix.jpg");
+  // Decode the textures and generate their mipmaps on worker threads while
+  // the rest of the scene is set up. They are uploaded before rendering.
+  std::future<MipChain> containerTextureChain = loadMipChainAsync(
+      "assets/container2.png", 3, true, kMipFilter);
+  std::future<MipChain> containerSpecularChain = loadMipChainAsync(
+      "assets/container2_specular.png", 3, true, kMipFilter);
+  std::future<MipChain> containerEmissionChain = loadMipChainAsync(
+      "assets/matrix.jpg", 3, true, kMipFilter);
 
   // Create and bind a framebuffer.
   GLuint FBO;
@@ -138,6 +209,12 @@ int main() {
   glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, frameColorBufferMultiSampled);
   glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, kMSAASamples, GL_RGB,
       fbWidth, fbHeight, GL_TRUE);
+
+  // The implementation may hand out more samples than asked for, the fused
+  // resolve has to go over all of them.
+  GLint frameSamples;
+  glGetTexLevelParameteriv(GL_TEXTURE_2D_MULTISAMPLE, 0, GL_TEXTURE_SAMPLES,
+      &frameSamples);
   glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
 
   // Attach the texture to the framebuffer.
@@ -161,36 +238,46 @@ int main() {
   // never happen if we attached the texture but it's good practice to check.
   if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
     std::cerr << "ERROR: Framebuffer is not complete!" << std::endl;
-    glfwTerminate();
     return 1;
   }
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-  // Generate texture for intermediate stage.
-  GLuint screenTexture;
-  glGenTextures(1, &screenTexture);
-  glBindTexture(GL_TEXTURE_2D, screenTexture);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, fbWidth, fbHeight, 0, GL_RGB,
-      GL_UNSIGNED_BYTE, nullptr);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glBindTexture(GL_TEXTURE_2D, 0);
-
-  // Second framebuffer for post.
-  GLuint intermediateFBO;
-  glGenFramebuffers(1, &intermediateFBO);
-  glBindFramebuffer(GL_FRAMEBUFFER, intermediateFBO);
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
-      screenTexture, 0);
-
-  // Panic if the framebuffer is somehow incomplete at this stage. This should
-  // never happen if we attached the texture but it's good practice to check.
-  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-    std::cerr << "ERROR: Framebuffer is not complete!" << std::endl;
-    glfwTerminate();
+  // G-buffer for deferred shading, lit into the framebuffer above so it goes
+  // through the same resolve and post-processing.
+  DeferredRenderer deferredRenderer(fbWidth, fbHeight, kMSAASamples);
+  if (!deferredRenderer.complete()) {
+    std::cerr << "ERROR: G-buffer is not complete!" << std::endl;
     return 1;
   }
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  // Generate texture for intermediate stage, only needed when the frame is
+  // blitted before post-processing.
+  GLuint screenTexture = 0;
+  GLuint intermediateFBO = 0;
+  if (!kFusedResolve) {
+    glGenTextures(1, &screenTexture);
+    glBindTexture(GL_TEXTURE_2D, screenTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, fbWidth, fbHeight, 0, GL_RGB,
+        GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // Second framebuffer for post.
+    glGenFramebuffers(1, &intermediateFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, intermediateFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+        GL_TEXTURE_2D, screenTexture, 0);
+
+    // Panic if the framebuffer is somehow incomplete at this stage. This
+    // should never happen if we attached the texture but it's good practice
+    // to check.
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+      std::cerr << "ERROR: Framebuffer is not complete!" << std::endl;
+      return 1;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  }
 
   // Container mesh data.
   GLfloat vertices[] = {
@@ -335,6 +422,11 @@ int main() {
   glEnableVertexAttribArray(1);
   glBindVertexArray(0);
 
+  // Upload the textures once their mip chains are ready.
+  GLuint containerTexture = loadTexture(containerTextureChain.get());
+  GLuint containerSpecular = loadTexture(containerSpecularChain.get());
+  GLuint containerEmission = loadTexture(containerEmissionChain.get());
+
   // Create a perspective camera to fit the viewport.
   screenWidth = (GLfloat)fbWidth;
   screenHeight = (GLfloat)fbHeight;
@@ -359,22 +451,107 @@ int main() {
     glm::vec3( 0.0f,  0.0f, -3.0f)
   };
 
+  // Point lights of the scene, handed to the shaders through the light
+  // buffers.
+  const glm::vec3 pointLightColors[] = {
+    glm::vec3(1.0f, 1.0f, 1.0f),
+    glm::vec3(1.0f, 1.0f, 1.0f),
+    glm::vec3(1.0f, 1.0f, 1.0f),
+    glm::vec3(1.0f, 1.0f, 1.0f)
+  };
+  std::vector<PointLight> pointLights;
+  for (GLuint i = 0; i < 4; i++) {
+    pointLights.push_back(makePointLight(pointLightPositions[i],
+        glm::vec3(0.05f), pointLightColors[i], glm::vec3(1.0f), 1.0f, 0.09f,
+        0.032f));
+  }
+
+  // The spot light is at most white, so its reach only depends on the
+  // attenuation.
+  const GLfloat attenuationRadius = lightRadius(1.0f, 0.09f, 0.032f, 1.0f);
+
+  // Light buffers and the froxel grid the point lights are binned into.
+  LightClusters lightClusters;
+
+  // Spheres bounding the containers in any orientation, reaching out to the
+  // corners of the unit cube. Lights are listed per container against them.
+  std::vector<glm::vec4> containerBounds;
+  for (GLuint i = 0; i < 10; i++) {
+    containerBounds.push_back(glm::vec4(cubePositions[i], sqrtf(3.0f) * 0.5f));
+  }
+
+  // Light benchmark progress, see kBenchmarkLights. Every light count takes
+  // a step per shading mode.
+  GLuint benchmarkStep = 0;
+  GLuint benchmarkFrame = 0;
+  double benchmarkBinTime = 0.0;
+  if (kBenchmarkLights) {
+    pointLights = randomPointLights(kBenchmarkMinLights);
+    shadingMode = ShadingMode::Forward;
+    std::cout << "lights  mode       shading (GPU)  binning (CPU)  " <<
+      "max per cluster" << std::endl;
+  }
+
+  // Times the lit containers on the GPU, shown in the window title every
+  // second.
+  GpuTimer lightingTimer;
+  GLfloat lastReport = 0.0f;
+
   // Render loop.
   while (!glfwWindowShouldClose(window)) {
     GLfloat currentFrame = glfwGetTime();
     delta = currentFrame - lastFrame;
     lastFrame = currentFrame;
 
+    // Move the light benchmark along. Measuring only starts a few frames into
+    // each step so no timings of the previous step are still in flight.
+    if (kBenchmarkLights) {
+      benchmarkFrame++;
+      if (benchmarkFrame == kBenchmarkWarmupFrames) {
+        lightingTimer.reset();
+        benchmarkBinTime = 0.0;
+      } else if (benchmarkFrame == kBenchmarkFrames) {
+        GLuint frames = kBenchmarkFrames - kBenchmarkWarmupFrames;
+        std::cout << std::setw(6) << pointLights.size() << "  " <<
+          std::setw(9) << std::left << shadingModeName(shadingMode) <<
+          std::right <<
+          std::fixed << std::setprecision(3) <<
+          std::setw(12) << lightingTimer.milliseconds() << " ms" <<
+          std::setw(12) << benchmarkBinTime / frames << " ms" <<
+          std::setw(17) << lightClusters.maxClusterLights << std::endl;
+
+        benchmarkStep++;
+        benchmarkFrame = 0;
+        GLuint count = kBenchmarkMinLights <<
+          (benchmarkStep / kShadingModeCount);
+        if (count > kBenchmarkMaxLights) {
+          glfwSetWindowShouldClose(window, GL_TRUE);
+        }
+        shadingMode = (ShadingMode)(benchmarkStep % kShadingModeCount);
+        pointLights = randomPointLights(std::min(count, kBenchmarkMaxLights));
+      }
+      if (shadingMode == ShadingMode::Listed ||
+          shadingMode == ShadingMode::Clustered) {
+        benchmarkBinTime += lightClusters.binMilliseconds;
+      }
+    }
+
     // Check and call events.
     glfwPollEvents();
     move(delta);
 
     // Bind the off screen framebuffer (for post-processing) and clear the
-    // screen to a nice blue color.
-    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
-    glClearColor(0.1f, 0.15f, 0.15f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glEnable(GL_DEPTH_TEST);
+    // screen to a nice blue color. Deferred shading draws the containers into
+    // the G-buffer instead and fills the framebuffer when lighting it.
+    bool deferredShading = shadingMode == ShadingMode::Deferred;
+    if (deferredShading) {
+      deferredRenderer.beginGeometry();
+    } else {
+      glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+      glClearColor(0.1f, 0.15f, 0.15f, 1.0f);
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      glEnable(GL_DEPTH_TEST);
+    }
 
     const GLfloat limitTime = 1.0f;
     fovTime += delta;
@@ -386,7 +563,9 @@ int main() {
     camera.fov = easeOutQuart(fovTime, startFov, (startFov - targetFov) * -1, limitTime);
     camera.update();
 
-    // Bind the VAO and shader.
+    // Bind the VAO and shader. Uniforms the G-buffer shader doesn't have are
+    // ignored.
+    Shader& shader = deferredShading ? gBufferShader : forwardShader;
     glBindVertexArray(VAO);
     shader.use();
 
@@ -400,46 +579,19 @@ int main() {
     glm::vec3 lightColor(1.0f, 1.0f, 1.0f);
 
     // Directional light
-    glUniform3f(glGetUniformLocation(shader.program, "dirLight.direction"), 0.0f, -1.0f, 0.0f);
-    glUniform3f(glGetUniformLocation(shader.program, "dirLight.ambient"), 0.05f, 0.05f, 0.05f);
-    glUniform3f(glGetUniformLocation(shader.program, "dirLight.diffuse"), 1.0f, 1.0f, 1.0f);
-    glUniform3f(glGetUniformLocation(shader.program, "dirLight.specular"), 0.0f, 0.0f, 0.0f);
-
-    // Point light 1
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[0].position"), pointLightPositions[0].x, pointLightPositions[0].y, pointLightPositions[0].z);
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[0].ambient"), 0.05f, 0.05f, 0.05f);
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[0].diffuse"), 1.0f, 1.0f, 1.0f);
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[0].specular"), 1.0f, 1.0f, 1.0f);
-    glUniform1f(glGetUniformLocation(shader.program, "pointLights[0].constant"), 1.0f);
-    glUniform1f(glGetUniformLocation(shader.program, "pointLights[0].linear"), 0.09);
-    glUniform1f(glGetUniformLocation(shader.program, "pointLights[0].quadratic"), 0.032);
-
-    // Point light 2
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[1].position"), pointLightPositions[1].x, pointLightPositions[1].y, pointLightPositions[1].z);
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[1].ambient"), 0.05f, 0.05f, 0.05f);
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[1].diffuse"), 1.0f, 1.0f, 1.0f);
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[1].specular"), 1.0f, 1.0f, 1.0f);
-    glUniform1f(glGetUniformLocation(shader.program, "pointLights[1].constant"), 1.0f);
-    glUniform1f(glGetUniformLocation(shader.program, "pointLights[1].linear"), 0.09);
-    glUniform1f(glGetUniformLocation(shader.program, "pointLights[1].quadratic"), 0.032);
-
-    // Point light 3
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[2].position"), pointLightPositions[2].x, pointLightPositions[2].y, pointLightPositions[2].z);
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[2].ambient"), 0.05f, 0.05f, 0.05f);
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[2].diffuse"), 1.0f, 1.0f, 1.0f);
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[2].specular"), 1.0f, 1.0f, 1.0f);
-    glUniform1f(glGetUniformLocation(shader.program, "pointLights[2].constant"), 1.0f);
-    glUniform1f(glGetUniformLocation(shader.program, "pointLights[2].linear"), 0.09);
-    glUniform1f(glGetUniformLocation(shader.program, "pointLights[2].quadratic"), 0.032);
-
-    // Point light 4
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[3].position"), pointLightPositions[3].x, pointLightPositions[3].y, pointLightPositions[3].z);
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[3].ambient"), 0.05f, 0.05f, 0.05f);
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[3].diffuse"), 1.0f, 1.0f, 1.0f);
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[3].specular"), 1.0f, 1.0f, 1.0f);
-    glUniform1f(glGetUniformLocation(shader.program, "pointLights[3].constant"), 1.0f);
-    glUniform1f(glGetUniformLocation(shader.program, "pointLights[3].linear"), 0.09);
-    glUniform1f(glGetUniformLocation(shader.program, "pointLights[3].quadratic"), 0.032);
+    setDirectionalLight(shader);
+
+    // Point lights, binned into the clusters they reach when clustering or
+    // listed for the containers they reach when listing. The deferred
+    // renderer binds them itself.
+    lightClusters.update(pointLights, camera,
+        shadingMode == ShadingMode::Clustered);
+    if (shadingMode == ShadingMode::Listed) {
+      lightClusters.listObjects(pointLights, containerBounds);
+    }
+    if (!deferredShading) {
+      lightClusters.bind(shader, 3, fbWidth, fbHeight);
+    }
 
     // Sport light 1
     glUniform3f(glGetUniformLocation(shader.program, "spotLights[0].position"), camera.position.x, camera.position.y, camera.position.z);
@@ -450,6 +602,7 @@ int main() {
     glUniform1f(glGetUniformLocation(shader.program, "spotLights[0].constant"), 1.0f);
     glUniform1f(glGetUniformLocation(shader.program, "spotLights[0].linear"), 0.09);
     glUniform1f(glGetUniformLocation(shader.program, "spotLights[0].quadratic"), 0.032);
+    glUniform1f(glGetUniformLocation(shader.program, "spotLights[0].radius"), attenuationRadius);
     glUniform1f(glGetUniformLocation(shader.program, "spotLights[0].cutoff"), glm::cos(glm::radians(12.5f)));
     glUniform1f(glGetUniformLocation(shader.program, "spotLights[0].outerCutoff"), glm::cos(glm::radians(15.5f)));
 
@@ -480,6 +633,7 @@ int main() {
     // Draw multiple containers!
     GLuint modelMatrix = glGetUniformLocation(shader.program, "model");
     GLuint normalMatrix = glGetUniformLocation(shader.program, "normalMatrix");
+    lightingTimer.begin();
     for (GLuint i = 0; i < 10; i++) {
       // Apply world transformations.
       model = glm::mat4();
@@ -489,9 +643,38 @@ int main() {
       // Calculate the normal matrix on the CPU (keep them normals perpendicular).
       normal = glm::mat3(glm::transpose(glm::inverse(model)));
       glUniformMatrix3fv(normalMatrix, 1, GL_FALSE, glm::value_ptr(normal));
+      // Only shade the lights reaching this container when listing.
+      if (shadingMode == ShadingMode::Listed) {
+        lightClusters.bindObject(shader, i);
+      }
       // Draw the container.
       glDrawArrays(GL_TRIANGLES, 0, 36);
     }
+
+    // Light the G-buffer with the same lights as the forward shader.
+    if (deferredShading) {
+      deferredRenderer.lightShader.use();
+      GLuint lightProgram = deferredRenderer.lightShader.program;
+      setDirectionalLight(deferredRenderer.lightShader);
+      glUniform3f(glGetUniformLocation(lightProgram, "viewPos"),
+          camera.position.x, camera.position.y, camera.position.z);
+      glUniform1f(glGetUniformLocation(lightProgram, "shininess"), 32.0f);
+      glUniform3f(glGetUniformLocation(lightProgram, "background"), 0.1f,
+          0.15f, 0.15f);
+      deferredRenderer.light(FBO, camera, pointLights, lightClusters, 0);
+      glBindVertexArray(0);
+    }
+    lightingTimer.end();
+
+    // Show the average time spent shading the containers every second.
+    if (!kBenchmarkLights && currentFrame - lastReport >= 1.0f) {
+      std::ostringstream title;
+      title << "LearnGL (" << shadingModeName(shadingMode) << " lighting " <<
+        lightingTimer.milliseconds() << " ms)";
+      glfwSetWindowTitle(window, title.str().c_str());
+      lightingTimer.reset();
+      lastReport = currentFrame;
+    }
     glBindVertexArray(0);
 
     // Bind the VAO and shader.
@@ -526,10 +709,12 @@ int main() {
     //glBindVertexArray(0);
     //glEnable(GL_DEPTH_TEST);
 
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, intermediateFBO);
-    glBlitFramebuffer(0, 0, fbWidth, fbHeight, 0, 0, fbWidth, fbHeight,
-        GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    if (!kFusedResolve) {
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+      glBindFramebuffer(GL_DRAW_FRAMEBUFFER, intermediateFBO);
+      glBlitFramebuffer(0, 0, fbWidth, fbHeight, 0, 0, fbWidth, fbHeight,
+          GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    }
 
     // Unbind the offscreen framebuffer containing the unprocessed frame.
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -540,13 +725,20 @@ int main() {
     postShader.use();
     glBindVertexArray(frameVAO);
 
-    // Send the texture sampler to the shader.
+    // Send the texture samplers to the shader. With the fused resolve the
+    // samples of the multisampled frame are read directly, otherwise the
+    // blitted copy is.
     GLuint frameTexture = glGetUniformLocation(postShader.program, "frameTexture");
     time = glGetUniformLocation(postShader.program, "time");
     glUniform1i(frameTexture, 0);
+    glUniform1i(glGetUniformLocation(postShader.program, "frameSamples"), 1);
+    glUniform1i(glGetUniformLocation(postShader.program, "frameSampleCount"),
+        kFusedResolve ? frameSamples : 0);
     glUniform1f(time, glfwGetTime());
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, screenTexture);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, frameColorBufferMultiSampled);
 
     // Render the color buffer in the framebuffer to the quad with post shader.
     glDrawArrays(GL_TRIANGLES, 0, 6);
@@ -564,13 +756,10 @@ int main() {
   glDeleteVertexArrays(1, &VAO);
   glDeleteBuffers(1, &VBO);
 
-  // Terminate GLFW and clean any resources before exiting.
-  glfwTerminate();
-
   return 0;
 }
 
-GLuint loadTexture(std::string filepath) {
+GLuint loadTexture(const MipChain& chain) {
   // Generate the texture on the OpenGL side and bind it.
   GLuint texture;
   glGenTextures(1, &texture);
@@ -581,17 +770,15 @@ GLuint loadTexture(std::string filepath) {
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-  // Load in the container texture using the soil library.
-  int width, height;
-  unsigned char* image = SOIL_load_image(filepath.c_str(), &width, &height, 0, SOIL_LOAD_RGB);
+  // Upload every level of the mip chain. The levels were filtered in linear
+  // space on the CPU so they don't rely on the driver handling sRGB properly.
+  uploadMipChain(GL_TEXTURE_2D, chain);
 
-  // Load the image data to the currently bound texture. Also create some
-  // mipmaps for it for perf.
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-  glGenerateMipmap(GL_TEXTURE_2D);
+  if (kBenchmarkMipmaps) {
+    benchmarkMipChain(chain, kMipFilter);
+  }
 
-  // Free the image and unbind the texture.
-  SOIL_free_image_data(image);
+  // Unbind the texture.
   glBindTexture(GL_TEXTURE_2D, 0);
 
   return texture;
@@ -628,6 +815,54 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mode
   if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
     glfwSetWindowShouldClose(window, GL_TRUE);
   }
+
+  // Cycle through forward, listed, clustered and deferred shading.
+  if (key == GLFW_KEY_C && action == GLFW_PRESS) {
+    GLuint next = ((GLuint)shadingMode + 1) % kShadingModeCount;
+    shadingMode = (ShadingMode)next;
+  }
+}
+
+std::vector<PointLight> randomPointLights(GLuint count) {
+  // Seeded by the count so every run benchmarks the same lights.
+  std::mt19937 random(count);
+  std::uniform_real_distribution<GLfloat> x(-6.0f, 6.0f);
+  std::uniform_real_distribution<GLfloat> y(-4.0f, 6.0f);
+  std::uniform_real_distribution<GLfloat> z(-16.0f, 2.0f);
+  std::uniform_real_distribution<GLfloat> color(0.2f, 1.0f);
+
+  // Short ranged lights, a few units each, so they are spread over the scene
+  // rather than all of them lighting everything.
+  std::vector<PointLight> lights;
+  for (GLuint i = 0; i < count; i++) {
+    glm::vec3 position(x(random), y(random), z(random));
+    glm::vec3 diffuse(color(random), color(random), color(random));
+    lights.push_back(makePointLight(position, glm::vec3(0.0f), diffuse,
+        diffuse, 1.0f, 0.7f, 1.8f));
+  }
+
+  return lights;
+}
+
+const char* shadingModeName(ShadingMode mode) {
+  switch (mode) {
+    case ShadingMode::Forward:
+      return "forward";
+    case ShadingMode::Listed:
+      return "listed";
+    case ShadingMode::Clustered:
+      return "clustered";
+    case ShadingMode::Deferred:
+      return "deferred";
+  }
+  return "";
+}
+
+void setDirectionalLight(const Shader& shader) {
+  glUniform3f(glGetUniformLocation(shader.program, "dirLight.direction"), 0.0f, -1.0f, 0.0f);
+  glUniform3f(glGetUniformLocation(shader.program, "dirLight.ambient"), 0.05f, 0.05f, 0.05f);
+  glUniform3f(glGetUniformLocation(shader.program, "dirLight.diffuse"), 1.0f, 1.0f, 1.0f);
+  glUniform3f(glGetUniformLocation(shader.program, "dirLight.specular"), 0.0f, 0.0f, 0.0f);
 }
 
 void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
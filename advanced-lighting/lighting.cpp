@@ -0,0 +1,39 @@
+#include "lighting.h"
+
+#include <algorithm>
+#include <math.h>
+
+GLfloat lightRadius(GLfloat constant, GLfloat linear, GLfloat quadratic,
+    GLfloat intensity) {
+  // Solve intensity / (constant + linear * d + quadratic * d^2) = cutoff for
+  // the distance d.
+  GLfloat falloff = intensity / kLightCutoff - constant;
+  if (falloff <= 0.0f) {
+    return 0.0f;
+  }
+  if (quadratic <= 0.0f) {
+    return linear > 0.0f ? falloff / linear : INFINITY;
+  }
+
+  return (-linear + sqrtf(linear * linear + 4.0f * quadratic * falloff)) /
+    (2.0f * quadratic);
+}
+
+PointLight makePointLight(glm::vec3 position, glm::vec3 ambient,
+    glm::vec3 diffuse, glm::vec3 specular, GLfloat constant, GLfloat linear,
+    GLfloat quadratic) {
+  PointLight light;
+  light.position = position;
+  light.ambient = ambient;
+  light.diffuse = diffuse;
+  light.specular = specular;
+  light.constant = constant;
+  light.linear = linear;
+  light.quadratic = quadratic;
+
+  glm::vec3 brightest = glm::max(ambient, glm::max(diffuse, specular));
+  light.radius = lightRadius(constant, linear, quadratic,
+      std::max(brightest.x, std::max(brightest.y, brightest.z)));
+
+  return light;
+}
@@ -0,0 +1,487 @@
+#include "mipmap.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <thread>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+extern "C" {
+#include <SOIL/SOIL.h>
+}
+
+// Texels are filtered as four linear floats regardless of the channel count of
+// the image so a texel always fits in a single SSE register.
+const GLsizei kWorkChannels = 4;
+
+// Minimum amount of rows handed to a thread, smaller levels are not worth the
+// cost of spawning threads for.
+const GLsizei kMinRowsPerThread = 16;
+
+// Filters never read more than this many source texels along an axis. The
+// Kaiser filter uses all of them, three on each side of the destination texel.
+const GLsizei kMaxTaps = 6;
+const double kKaiserRadius = 3.0;
+const double kKaiserAlpha = 4.0;
+const double kPi = 3.14159265358979323846;
+
+// Resolution of the table used to go from linear values back to sRGB bytes.
+const GLuint kLinearToSRGBSize = 4096;
+
+static float srgbToLinear(float c) {
+  return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linearToSRGB(float c) {
+  return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+// Lookup tables for the sRGB transfer function since pow per channel per texel
+// is by far the slowest part of the whole process otherwise.
+struct ColorTables {
+  float toLinear[256];
+  GLubyte toSRGB[kLinearToSRGBSize + 1];
+
+  ColorTables() {
+    for (GLuint i = 0; i < 256; i++) {
+      toLinear[i] = srgbToLinear(i / 255.0f);
+    }
+    for (GLuint i = 0; i <= kLinearToSRGBSize; i++) {
+      toSRGB[i] = (GLubyte)(linearToSRGB((float)i / kLinearToSRGBSize) * 255.0f + 0.5f);
+    }
+  }
+};
+
+static const ColorTables& colorTables() {
+  static const ColorTables tables;
+  return tables;
+}
+
+// Modified Bessel function of the first kind used by the Kaiser window.
+static double besselI0(double x) {
+  double sum = 1.0;
+  double term = 1.0;
+  for (int k = 1; k < 32; k++) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+  }
+  return sum;
+}
+
+// Source texels and their weights contributing to one destination texel along
+// a single axis. Indices outside the level are clamped to the edge.
+struct FilterTaps {
+  GLsizei first;
+  GLsizei count;
+  float weights[kMaxTaps];
+};
+
+// Builds the taps for every destination texel of an axis going from srcSize
+// to dstSize texels. Both filters work off the exact footprint of the
+// destination texel so odd sized levels are weighted correctly instead of
+// dropping their last row or column.
+static std::vector<FilterTaps> filterTaps(GLsizei srcSize, GLsizei dstSize,
+    MipFilter filter) {
+  std::vector<FilterTaps> taps(dstSize);
+  double scale = (double)srcSize / dstSize;
+
+  for (GLsizei x = 0; x < dstSize; x++) {
+    FilterTaps& tap = taps[x];
+    double start = x * scale;
+    double end = start + scale;
+    double center = start + scale * 0.5;
+    double total = 0.0;
+
+    if (filter == MipFilter::Kaiser) {
+      tap.first = (GLsizei)std::floor(center - 0.5) - (kMaxTaps / 2 - 1);
+    } else {
+      tap.first = (GLsizei)std::floor(start);
+    }
+
+    for (GLsizei i = 0; i < kMaxTaps; i++) {
+      double texel = tap.first + i;
+      double weight;
+
+      if (filter == MipFilter::Kaiser) {
+        // Windowed sinc with its cutoff at the Nyquist limit of the smaller
+        // level.
+        double distance = texel + 0.5 - center;
+        double t = kPi * distance / scale;
+        double sinc = t == 0.0 ? 1.0 : std::sin(t) / t;
+        double u = distance / kKaiserRadius;
+        double window = u * u < 1.0 ?
+          besselI0(kKaiserAlpha * std::sqrt(1.0 - u * u)) / besselI0(kKaiserAlpha) :
+          0.0;
+        weight = sinc * window;
+      } else {
+        // Box filter, weighted by how much of the source texel is covered.
+        weight = std::max(0.0, std::min(texel + 1.0, end) - std::max(texel, start));
+      }
+
+      tap.weights[i] = (float)weight;
+      total += weight;
+    }
+
+    // Drop the trailing taps that ended up with no weight (most of them for
+    // the box filter) so the passes below skip them.
+    tap.count = kMaxTaps;
+    while (tap.count > 1 && tap.weights[tap.count - 1] == 0.0f) {
+      tap.count--;
+    }
+
+    for (GLsizei i = 0; i < tap.count; i++) {
+      tap.weights[i] = (float)(tap.weights[i] / total);
+    }
+  }
+
+  return taps;
+}
+
+
+// Number of channels holding color, the rest (if any) is alpha.
+static GLuint colorChannels(GLuint channels) {
+  return channels == 2 || channels == 4 ? channels - 1 : channels;
+}
+
+// Runs work over [0, rows) split in contiguous chunks between threads. The
+// calling thread takes the first chunk itself.
+static void parallelRows(GLsizei rows, GLuint threads,
+    const std::function<void(GLsizei, GLsizei)>& work) {
+  GLsizei count = std::min((GLsizei)threads,
+      std::max((GLsizei)1, rows / kMinRowsPerThread));
+  if (count <= 1) {
+    work(0, rows);
+    return;
+  }
+
+  GLsizei chunk = (rows + count - 1) / count;
+  std::vector<std::thread> workers;
+  for (GLsizei begin = chunk; begin < rows; begin += chunk) {
+    workers.push_back(std::thread(work, begin, std::min(rows, begin + chunk)));
+  }
+
+  work(0, chunk);
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+// Converts rows of 8-bit texels into linear float working texels.
+static void expandRows(const GLubyte* image, GLsizei width, GLuint channels,
+    bool srgb, float* out, GLsizei begin, GLsizei end) {
+  const ColorTables& tables = colorTables();
+  GLuint color = srgb ? colorChannels(channels) : 0;
+
+  for (GLsizei y = begin; y < end; y++) {
+    const GLubyte* in = image + (size_t)y * width * channels;
+    float* row = out + (size_t)y * width * kWorkChannels;
+
+    for (GLsizei x = 0; x < width; x++) {
+      for (GLuint c = 0; c < (GLuint)kWorkChannels; c++) {
+        float value = 0.0f;
+        if (c < color) {
+          value = tables.toLinear[in[c]];
+        } else if (c < channels) {
+          value = in[c] / 255.0f;
+        }
+        row[c] = value;
+      }
+      in += channels;
+      row += kWorkChannels;
+    }
+  }
+}
+
+// Converts rows of linear float working texels back into 8-bit texels.
+static void quantizeRows(const float* src, GLsizei width, GLuint channels,
+    bool srgb, GLubyte* out, GLsizei begin, GLsizei end) {
+  const ColorTables& tables = colorTables();
+  GLuint color = srgb ? colorChannels(channels) : 0;
+
+  for (GLsizei y = begin; y < end; y++) {
+    const float* row = src + (size_t)y * width * kWorkChannels;
+    GLubyte* texel = out + (size_t)y * width * channels;
+
+    for (GLsizei x = 0; x < width; x++) {
+      for (GLuint c = 0; c < channels; c++) {
+        float value = std::min(std::max(row[c], 0.0f), 1.0f);
+        if (c < color) {
+          texel[c] = tables.toSRGB[(GLuint)(value * kLinearToSRGBSize + 0.5f)];
+        } else {
+          texel[c] = (GLubyte)(value * 255.0f + 0.5f);
+        }
+      }
+      row += kWorkChannels;
+      texel += channels;
+    }
+  }
+}
+
+// Horizontal pass, filters every source row down to the destination width.
+static void filterRowsHorizontal(const float* src, GLsizei srcWidth,
+    const std::vector<FilterTaps>& taps, float* dst, GLsizei begin,
+    GLsizei end) {
+  GLsizei dstWidth = taps.size();
+
+  for (GLsizei y = begin; y < end; y++) {
+    const float* row = src + (size_t)y * srcWidth * kWorkChannels;
+    float* out = dst + (size_t)y * dstWidth * kWorkChannels;
+
+    for (GLsizei x = 0; x < dstWidth; x++) {
+      const FilterTaps& tap = taps[x];
+
+#ifdef __SSE2__
+      __m128 sum = _mm_setzero_ps();
+      for (GLsizei i = 0; i < tap.count; i++) {
+        GLsizei sx = std::min(std::max(tap.first + i, 0), srcWidth - 1);
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(tap.weights[i]),
+            _mm_loadu_ps(row + sx * kWorkChannels)));
+      }
+      _mm_storeu_ps(out, sum);
+#else
+      for (GLsizei c = 0; c < kWorkChannels; c++) {
+        out[c] = 0.0f;
+      }
+      for (GLsizei i = 0; i < tap.count; i++) {
+        GLsizei sx = std::min(std::max(tap.first + i, 0), srcWidth - 1);
+        for (GLsizei c = 0; c < kWorkChannels; c++) {
+          out[c] += tap.weights[i] * row[sx * kWorkChannels + c];
+        }
+      }
+#endif
+      out += kWorkChannels;
+    }
+  }
+}
+
+// Vertical pass, filters the horizontally filtered rows down to the
+// destination height. Negative lobes of the Kaiser filter can overshoot so the
+// result is clamped back into range.
+static void filterRowsVertical(const float* src, GLsizei width,
+    GLsizei srcHeight, const std::vector<FilterTaps>& taps, float* dst,
+    GLsizei begin, GLsizei end) {
+  const float* rows[kMaxTaps];
+
+  for (GLsizei y = begin; y < end; y++) {
+    const FilterTaps& tap = taps[y];
+    for (GLsizei i = 0; i < tap.count; i++) {
+      GLsizei sy = std::min(std::max(tap.first + i, 0), srcHeight - 1);
+      rows[i] = src + (size_t)sy * width * kWorkChannels;
+    }
+    float* out = dst + (size_t)y * width * kWorkChannels;
+
+    for (GLsizei x = 0; x < width * kWorkChannels; x += kWorkChannels) {
+#ifdef __SSE2__
+      __m128 sum = _mm_setzero_ps();
+      for (GLsizei i = 0; i < tap.count; i++) {
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(tap.weights[i]),
+            _mm_loadu_ps(rows[i] + x)));
+      }
+      sum = _mm_min_ps(_mm_max_ps(sum, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+      _mm_storeu_ps(out + x, sum);
+#else
+      for (GLsizei c = 0; c < kWorkChannels; c++) {
+        float sum = 0.0f;
+        for (GLsizei i = 0; i < tap.count; i++) {
+          sum += tap.weights[i] * rows[i][x + c];
+        }
+        out[x + c] = std::min(std::max(sum, 0.0f), 1.0f);
+      }
+#endif
+    }
+  }
+}
+
+MipChain generateMipChain(const GLubyte* image, GLsizei width, GLsizei height,
+    GLuint channels, bool srgb, MipFilter filter, GLuint threads) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  MipChain chain;
+  chain.channels = channels;
+  chain.srgb = srgb;
+
+  // The base level is uploaded untouched, only the smaller levels are
+  // filtered.
+  MipLevel base;
+  base.width = width;
+  base.height = height;
+  base.data.assign(image, image + (size_t)width * height * channels);
+  chain.levels.push_back(std::move(base));
+
+  std::vector<float> src((size_t)width * height * kWorkChannels);
+  parallelRows(height, threads, [&](GLsizei begin, GLsizei end) {
+    expandRows(image, width, channels, srgb, src.data(), begin, end);
+  });
+
+  std::vector<float> dst;
+  std::vector<float> tmp;
+  while (width > 1 || height > 1) {
+    GLsizei dstWidth = std::max(1, width / 2);
+    GLsizei dstHeight = std::max(1, height / 2);
+    std::vector<FilterTaps> tapsX = filterTaps(width, dstWidth, filter);
+    std::vector<FilterTaps> tapsY = filterTaps(height, dstHeight, filter);
+    tmp.resize((size_t)dstWidth * height * kWorkChannels);
+    dst.resize((size_t)dstWidth * dstHeight * kWorkChannels);
+
+    MipLevel level;
+    level.width = dstWidth;
+    level.height = dstHeight;
+    level.data.resize((size_t)dstWidth * dstHeight * channels);
+
+    // The filters are separable so each level is two passes. Threads quantize
+    // the rows they just filtered while those are still warm in their cache.
+    parallelRows(height, threads, [&](GLsizei begin, GLsizei end) {
+      filterRowsHorizontal(src.data(), width, tapsX, tmp.data(), begin, end);
+    });
+    parallelRows(dstHeight, threads, [&](GLsizei begin, GLsizei end) {
+      filterRowsVertical(tmp.data(), dstWidth, height, tapsY, dst.data(),
+          begin, end);
+      quantizeRows(dst.data(), dstWidth, channels, srgb, level.data.data(),
+          begin, end);
+    });
+
+    chain.levels.push_back(std::move(level));
+    src.swap(dst);
+    width = dstWidth;
+    height = dstHeight;
+  }
+
+  return chain;
+}
+
+std::future<MipChain> loadMipChainAsync(const std::string& filepath,
+    GLuint channels, bool srgb, MipFilter filter) {
+  return std::async(std::launch::async, [=]() -> MipChain {
+    // SOIL's load flags happen to match the channel count they force.
+    int width, height;
+    unsigned char* image = SOIL_load_image(filepath.c_str(), &width, &height,
+        0, channels);
+    if (image == nullptr) {
+      std::cerr << "ERROR: Unable to load texture " << filepath << std::endl;
+      MipChain empty;
+      empty.channels = channels;
+      empty.srgb = srgb;
+      return empty;
+    }
+
+    MipChain chain = generateMipChain(image, width, height, channels, srgb,
+        filter);
+    SOIL_free_image_data(image);
+
+    return chain;
+  });
+}
+
+// Picks the internal format and pixel format for the chain.
+static void chainFormats(const MipChain& chain, GLint* internalFormat,
+    GLenum* format) {
+  static const GLenum formats[] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+  *format = formats[chain.channels - 1];
+  *internalFormat = *format;
+
+  if (chain.srgb && chain.channels == 3) {
+    *internalFormat = GL_SRGB8;
+  } else if (chain.srgb && chain.channels == 4) {
+    *internalFormat = GL_SRGB8_ALPHA8;
+  }
+}
+
+void uploadMipChain(GLenum target, const MipChain& chain) {
+  if (chain.levels.empty()) {
+    return;
+  }
+
+  GLint internalFormat;
+  GLenum format;
+  chainFormats(chain, &internalFormat, &format);
+
+  // Rows of the small levels are no longer 4 byte aligned.
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for (GLuint i = 0; i < chain.levels.size(); i++) {
+    const MipLevel& level = chain.levels[i];
+    glTexImage2D(target, i, internalFormat, level.width, level.height, 0,
+        format, GL_UNSIGNED_BYTE, level.data.data());
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+  glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+  glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, chain.levels.size() - 1);
+}
+
+void benchmarkMipChain(const MipChain& chain, MipFilter filter) {
+  typedef std::chrono::high_resolution_clock Clock;
+  typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+  if (chain.levels.empty()) {
+    return;
+  }
+
+  const MipLevel& base = chain.levels[0];
+  GLint internalFormat;
+  GLenum format;
+  chainFormats(chain, &internalFormat, &format);
+
+  GLuint textures[2];
+  glGenTextures(2, textures);
+  glFinish();
+
+  // CPU path: generate every level and upload them.
+  Clock::time_point start = Clock::now();
+  MipChain cpuChain = generateMipChain(base.data.data(), base.width,
+      base.height, chain.channels, chain.srgb, filter);
+  glBindTexture(GL_TEXTURE_2D, textures[0]);
+  uploadMipChain(GL_TEXTURE_2D, cpuChain);
+  glFinish();
+  Milliseconds cpuTime = Clock::now() - start;
+
+  // Driver path: upload the base level and let glGenerateMipmap do the rest.
+  start = Clock::now();
+  glBindTexture(GL_TEXTURE_2D, textures[1]);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, base.width, base.height, 0,
+      format, GL_UNSIGNED_BYTE, base.data.data());
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glGenerateMipmap(GL_TEXTURE_2D);
+  glFinish();
+  Milliseconds driverTime = Clock::now() - start;
+
+  std::cout << "Mipmaps " << base.width << "x" << base.height << ": CPU "
+    << cpuTime.count() << "ms, glGenerateMipmap " << driverTime.count()
+    << "ms" << std::endl;
+
+  // Read the driver's levels back (sRGB textures are returned encoded) and
+  // compare them to ours.
+  std::vector<GLubyte> pixels;
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  for (GLuint i = 1; i < cpuChain.levels.size(); i++) {
+    const MipLevel& level = cpuChain.levels[i];
+    pixels.resize(level.data.size());
+    glGetTexImage(GL_TEXTURE_2D, i, format, GL_UNSIGNED_BYTE, pixels.data());
+
+    int maxError = 0;
+    double squaredError = 0.0;
+    for (size_t j = 0; j < pixels.size(); j++) {
+      int error = std::abs((int)pixels[j] - (int)level.data[j]);
+      maxError = std::max(maxError, error);
+      squaredError += error * error;
+    }
+
+    double mse = squaredError / pixels.size();
+    double psnr = mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) :
+      std::numeric_limits<double>::infinity();
+    std::cout << "  level " << i << " (" << level.width << "x" << level.height
+      << "): max error " << maxError << ", PSNR " << psnr << "dB" << std::endl;
+  }
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glDeleteTextures(2, textures);
+}
@@ -84,18 +84,33 @@ void Shader::use() {
 }
 
 std::string Shader::readShader(std::string filepath) {
-  std::ifstream vertexShaderFile(filepath);
+  std::ifstream shaderFile(filepath);
+
+  if (shaderFile) {
+    // Included files are looked up next to the file including them.
+    std::string directory = filepath.substr(0, filepath.find_last_of('/') + 1);
+    const std::string directive = "#include \"";
 
-  if (vertexShaderFile) {
     std::ostringstream buffer;
-    buffer << vertexShaderFile.rdbuf();
-    vertexShaderFile.close();
+    std::string line;
+    while (std::getline(shaderFile, line)) {
+      // GLSL has no includes of its own, so paste the included file in place
+      // of the directive.
+      if (line.compare(0, directive.size(), directive) == 0) {
+        std::string::size_type end = line.find('"', directive.size());
+        buffer << readShader(directory +
+            line.substr(directive.size(), end - directive.size()));
+      } else {
+        buffer << line << '\n';
+      }
+    }
+    shaderFile.close();
 
     return buffer.str();
   } else {
     // Panic when the shader cannot be found. The assumption is made that there
     // is no good reason to use missing shaders.
-    std::cerr << "ERROR: Unable to read vertex shader" << std::endl;
+    std::cerr << "ERROR: Unable to read shader " << filepath << std::endl;
     glfwTerminate();
     exit(1);
   }
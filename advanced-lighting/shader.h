@@ -23,6 +23,8 @@ class Shader {
     void use();
   private:
     // Reads a shader (or any file for that matter) and puts it into a string.
+    // Lines of the form #include "file" are replaced by the contents of that
+    // file, relative to the directory of the file being read.
     std::string readShader(std::string filepath);
 
     // Compiles a shader of the specified type.
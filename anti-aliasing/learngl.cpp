@@ -26,6 +26,11 @@ const GLuint kWindowHeight = 600;
 // Number of default samples to use with MSAA.
 const GLuint kMSAASamples = 32;
 
+// Resolve the multisampled frame in the post-processing shader rather than
+// blitting it into an intermediate texture first, which saves writing and then
+// reading back a full screen texture every frame.
+const bool kFusedResolve = true;
+
 glm::mat4 model;
 glm::mat3 normal;
 
@@ -135,6 +140,12 @@ int main() {
   glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, frameColorBufferMultiSampled);
   glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, kMSAASamples, GL_RGB,
       fbWidth, fbHeight, GL_TRUE);
+
+  // The implementation may hand out more samples than asked for, the fused
+  // resolve has to go over all of them.
+  GLint frameSamples;
+  glGetTexLevelParameteriv(GL_TEXTURE_2D_MULTISAMPLE, 0, GL_TEXTURE_SAMPLES,
+      &frameSamples);
   glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
 
   // Attach the texture to the framebuffer.
@@ -163,31 +174,35 @@ int main() {
   }
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-  // Generate texture for intermediate stage.
-  GLuint screenTexture;
-  glGenTextures(1, &screenTexture);
-  glBindTexture(GL_TEXTURE_2D, screenTexture);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, fbWidth, fbHeight, 0, GL_RGB,
-      GL_UNSIGNED_BYTE, nullptr);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glBindTexture(GL_TEXTURE_2D, 0);
-
-  // Second framebuffer for post.
-  GLuint intermediateFBO;
-  glGenFramebuffers(1, &intermediateFBO);
-  glBindFramebuffer(GL_FRAMEBUFFER, intermediateFBO);
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
-      screenTexture, 0);
-
-  // Panic if the framebuffer is somehow incomplete at this stage. This should
-  // never happen if we attached the texture but it's good practice to check.
-  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-    std::cerr << "ERROR: Framebuffer is not complete!" << std::endl;
-    glfwTerminate();
-    return 1;
+  // Generate texture for intermediate stage, only needed when the frame is
+  // blitted before post-processing.
+  GLuint screenTexture = 0;
+  GLuint intermediateFBO = 0;
+  if (!kFusedResolve) {
+    glGenTextures(1, &screenTexture);
+    glBindTexture(GL_TEXTURE_2D, screenTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, fbWidth, fbHeight, 0, GL_RGB,
+        GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // Second framebuffer for post.
+    glGenFramebuffers(1, &intermediateFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, intermediateFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+        GL_TEXTURE_2D, screenTexture, 0);
+
+    // Panic if the framebuffer is somehow incomplete at this stage. This
+    // should never happen if we attached the texture but it's good practice
+    // to check.
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+      std::cerr << "ERROR: Framebuffer is not complete!" << std::endl;
+      glfwTerminate();
+      return 1;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
   }
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
   // Container mesh data.
   GLfloat vertices[] = {
@@ -523,10 +538,12 @@ int main() {
     //glBindVertexArray(0);
     //glEnable(GL_DEPTH_TEST);
 
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, intermediateFBO);
-    glBlitFramebuffer(0, 0, fbWidth, fbHeight, 0, 0, fbWidth, fbHeight,
-        GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    if (!kFusedResolve) {
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+      glBindFramebuffer(GL_DRAW_FRAMEBUFFER, intermediateFBO);
+      glBlitFramebuffer(0, 0, fbWidth, fbHeight, 0, 0, fbWidth, fbHeight,
+          GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    }
 
     // Unbind the offscreen framebuffer containing the unprocessed frame.
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -537,13 +554,20 @@ int main() {
     postShader.use();
     glBindVertexArray(frameVAO);
 
-    // Send the texture sampler to the shader.
+    // Send the texture samplers to the shader. With the fused resolve the
+    // samples of the multisampled frame are read directly, otherwise the
+    // blitted copy is.
     GLuint frameTexture = glGetUniformLocation(postShader.program, "frameTexture");
     time = glGetUniformLocation(postShader.program, "time");
     glUniform1i(frameTexture, 0);
+    glUniform1i(glGetUniformLocation(postShader.program, "frameSamples"), 1);
+    glUniform1i(glGetUniformLocation(postShader.program, "frameSampleCount"),
+        kFusedResolve ? frameSamples : 0);
     glUniform1f(time, glfwGetTime());
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, screenTexture);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, frameColorBufferMultiSampled);
 
     // Render the color buffer in the framebuffer to the quad with post shader.
     glDrawArrays(GL_TRIANGLES, 0, 6);
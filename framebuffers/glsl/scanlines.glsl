@@ -0,0 +1,6 @@
+// Pixel effect, darkens the rows where the wave swings left.
+vec3 scanlines(vec3 color, vec2 uv) {
+  // Scanline effect, just abuses the same wave as glsl/wave.glsl.
+  float wave = sin(time + floor(uv.t * 35) / 35) / 2;
+  return color + clamp(wave, -0.025f, 0.0f);
+}
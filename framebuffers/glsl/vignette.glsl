@@ -0,0 +1,5 @@
+// Pixel effect, fades the corners of the frame out.
+vec3 vignette(vec3 color, vec2 uv) {
+  vec2 centered = uv * 2.0f - 1.0f;
+  return color * (1.0f - 0.3f * dot(centered, centered));
+}
@@ -0,0 +1,10 @@
+// Kernel effect, shifts rows of the frame sideways along a sine wave.
+vec3 wave(sampler2D frame, vec2 uv) {
+  // Get the sine of time and add t to affect the sine wave depending on where
+  // the fragment is in the texture. Floor the addition so some vertical
+  // fragments get the same value giving off a retro feel.
+  float wave = sin(time + floor(uv.t * 35) / 35) / 2;
+
+  // Sample using the wave calculation added ontop of the normal coordinate.
+  return vec3(texture(frame, vec2(uv.s + wave / 2, uv.t)));
+}
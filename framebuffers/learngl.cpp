@@ -16,6 +16,7 @@ extern "C" {
 #include <SOIL/SOIL.h>
 }
 
+#include "postchain.h"
 #include "shader.h"
 #include "perspectivecamera.h"
 
@@ -49,6 +50,10 @@ bool firstMouseEvent = true;
 // Keyboard state.
 bool keys[1024];
 
+// Sets up the scene and renders it until the window is closed, returns the
+// exit status.
+int run(GLFWwindow* window, int fbWidth, int fbHeight);
+
 // Utility functions.
 GLuint loadTexture(std::string filepath);
 void move(GLfloat delta);
@@ -105,11 +110,21 @@ int main() {
   // prevent overlapping polygon artifacts.
   glEnable(GL_DEPTH_TEST);
 
+  // Everything owning GL objects lives in run so it gets deleted before the
+  // context goes away with glfwTerminate.
+  int status = run(window, fbWidth, fbHeight);
+
+  // Terminate GLFW and clean any resources before exiting.
+  glfwTerminate();
+
+  return status;
+}
+
+int run(GLFWwindow* window, int fbWidth, int fbHeight) {
   // Read and compile the vertex and fragment shaders using
   // the shader helper class.
   Shader shader("glsl/vertex.glsl", "glsl/fragment.glsl");
   Shader lampShader("glsl/lampvertex.glsl", "glsl/lampfragment.glsl");
-  Shader postShader("glsl/post_vert.glsl", "glsl/post_frag.glsl");
 
   GLuint containerTexture = loadTexture("assets/container2.png");
   GLuint containerSpecular = loadTexture("assets/container2_specular.png");
@@ -152,7 +167,6 @@ int main() {
   // never happen if we attached the texture but it's good practice to check.
   if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
     std::cerr << "ERROR: Framebuffer is not complete!" << std::endl;
-    glfwTerminate();
     return 1;
   }
 
@@ -248,34 +262,21 @@ int main() {
   glEnableVertexAttribArray(0);
   glBindVertexArray(0);
 
-  // Vertex attributes for the frame quad in NDC.
-  GLfloat frameVertices[] = {
-    // Positions  // UVs
-    -1.0f,  1.0f,  0.0f, 1.0f,
-    -1.0f, -1.0f,  0.0f, 0.0f,
-     1.0f, -1.0f,  1.0f, 0.0f,
-
-    -1.0f,  1.0f,  0.0f, 1.0f,
-     1.0f, -1.0f,  1.0f, 0.0f,
-     1.0f,  1.0f,  1.0f, 1.0f
-  };
-
-  // Create a VBO and VAO for the post-processing step.
-  GLuint frameVBO, frameVAO;
-  glGenVertexArrays(1, &frameVAO);
-  glGenBuffers(1, &frameVBO);
-
-  glBindVertexArray(frameVAO);
-  glBindBuffer(GL_ARRAY_BUFFER, frameVBO);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(frameVertices), frameVertices,
-      GL_STATIC_DRAW);
-  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat),
-      (GLvoid*)0);
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat),
-      (GLvoid*)(2 * sizeof(GLfloat)));
-  glEnableVertexAttribArray(1);
-  glBindVertexArray(0);
+  // Post-processing effects, fused into as few full screen passes as their
+  // reads allow. The wave reads around the pixel while the rest only change
+  // its color, so they all end up in one pass.
+  PostChain postChain(fbWidth, fbHeight);
+  postChain.add(PostEffectType::Kernel, "wave", "glsl/wave.glsl");
+  postChain.add(PostEffectType::Pixel, "scanlines", "glsl/scanlines.glsl");
+  postChain.add(PostEffectType::Pixel, "vignette", "glsl/vignette.glsl");
+  postChain.build();
+  if (!postChain.complete()) {
+    std::cerr << "ERROR: Post-processing framebuffer is not complete!" <<
+      std::endl;
+    return 1;
+  }
+  std::cout << "Post-processing " << postChain.effectCount() <<
+    " effects in " << postChain.passCount() << " passes" << std::endl;
 
   // Create a perspective camera to fit the viewport.
   screenWidth = (GLfloat)fbWidth;
@@ -464,20 +465,9 @@ int main() {
     glClear(GL_COLOR_BUFFER_BIT);
     glDisable(GL_DEPTH_TEST);
 
-    postShader.use();
-    glBindVertexArray(frameVAO);
-
-    // Send the texture sampler to the shader.
-    GLuint frameTexture = glGetUniformLocation(postShader.program, "frameTexture");
-    GLuint time = glGetUniformLocation(postShader.program, "time");
-    glUniform1i(frameTexture, 0);
-    glUniform1f(time, glfwGetTime());
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, frameColorBuffer);
-
-    // Render the color buffer in the framebuffer to the quad with post shader.
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-    glBindVertexArray(0);
+    // Render the color buffer in the framebuffer through the post-processing
+    // effects.
+    postChain.draw(frameColorBuffer, glfwGetTime());
 
     // Swap buffers used for double buffering.
     glfwSwapBuffers(window);
@@ -491,9 +481,6 @@ int main() {
   glDeleteVertexArrays(1, &VAO);
   glDeleteBuffers(1, &VBO);
 
-  // Terminate GLFW and clean any resources before exiting.
-  glfwTerminate();
-
   return 0;
 }
 
@@ -0,0 +1,185 @@
+#include "postchain.h"
+
+#include <algorithm>
+#include <set>
+#include <sstream>
+
+PostChain::PostChain(GLuint width, GLuint height) {
+  this->width = width;
+  this->height = height;
+  this->textures[0] = this->textures[1] = 0;
+  this->framebuffers[0] = this->framebuffers[1] = 0;
+  glGenVertexArrays(1, &this->VAO);
+}
+
+PostChain::~PostChain() {
+  release();
+  glDeleteVertexArrays(1, &this->VAO);
+}
+
+void PostChain::add(PostEffectType type, const std::string& function,
+    const GLchar* path) {
+  Effect effect;
+  effect.type = type;
+  effect.function = function;
+  effect.source = Shader::readShader(path);
+  this->effects.push_back(effect);
+}
+
+void PostChain::build() {
+  release();
+
+  // A kernel reads around the pixel, so unless nothing ran before it in the
+  // pass it has to start a new one reading the previous result from a
+  // texture. Pixel effects always join the pass they follow.
+  std::vector<std::vector<GLuint>> grouped;
+  for (GLuint i = 0; i < this->effects.size(); i++) {
+    if (grouped.empty() || this->effects[i].type == PostEffectType::Kernel) {
+      grouped.push_back(std::vector<GLuint>());
+    }
+    grouped.back().push_back(i);
+  }
+
+  // An empty chain still copies the frame over.
+  if (grouped.empty()) {
+    grouped.push_back(std::vector<GLuint>());
+  }
+
+  std::string vertexSource = Shader::readShader("glsl/chain_vert.glsl");
+  for (const std::vector<GLuint>& passEffects : grouped) {
+    Pass pass = { passEffects, Shader::fromSource(vertexSource,
+        fragmentSource(passEffects)) };
+    this->passes.push_back(pass);
+  }
+
+  // Every pass but the last writes to an intermediate target and the next
+  // one reads it, so two are enough to alternate between.
+  GLuint targets = std::min<GLuint>(this->passes.size() - 1, 2);
+  glGenTextures(targets, this->textures);
+  glGenFramebuffers(targets, this->framebuffers);
+  for (GLuint i = 0; i < targets; i++) {
+    glBindTexture(GL_TEXTURE_2D, this->textures[i]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, this->width, this->height, 0,
+        GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffers[i]);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+        GL_TEXTURE_2D, this->textures[i], 0);
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+bool PostChain::complete() {
+  for (GLuint i = 0; i < 2; i++) {
+    if (this->framebuffers[i] == 0) {
+      continue;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffers[i]);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void PostChain::draw(GLuint frameTexture, GLfloat time) {
+  GLint target;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+
+  glBindVertexArray(this->VAO);
+  glActiveTexture(GL_TEXTURE0);
+
+  // The first pass reads the frame, which is assumed to be as large as the
+  // intermediate targets.
+  GLuint source = frameTexture;
+  for (GLuint i = 0; i < this->passes.size(); i++) {
+    bool last = i + 1 == this->passes.size();
+    glBindFramebuffer(GL_FRAMEBUFFER,
+        last ? target : this->framebuffers[i % 2]);
+
+    Shader& shader = this->passes[i].shader;
+    shader.use();
+    glUniform1i(glGetUniformLocation(shader.program, "frameTexture"), 0);
+    glUniform1f(glGetUniformLocation(shader.program, "time"), time);
+    glUniform2f(glGetUniformLocation(shader.program, "texelSize"),
+        1.0f / this->width, 1.0f / this->height);
+    glBindTexture(GL_TEXTURE_2D, source);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    source = this->textures[i % 2];
+  }
+
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glBindVertexArray(0);
+}
+
+GLuint PostChain::passCount() const {
+  return this->passes.size();
+}
+
+GLuint PostChain::effectCount() const {
+  return this->effects.size();
+}
+
+std::string PostChain::fragmentSource(const std::vector<GLuint>& passEffects) {
+  std::ostringstream source;
+  source << "#version 330 core\n\n" <<
+    "in vec2 fragUv;\n" <<
+    "out vec4 color;\n\n" <<
+    "uniform sampler2D frameTexture;\n" <<
+    "uniform float time;\n" <<
+    "uniform vec2 texelSize;\n\n";
+
+  // Paste every source once, an effect may be in the pass several times and
+  // a file may define several effects.
+  std::set<std::string> pasted;
+  for (GLuint i : passEffects) {
+    const Effect& effect = this->effects[i];
+    if (pasted.insert(effect.source).second) {
+      source << effect.source << "\n";
+    }
+  }
+
+  // Read the pixel with the kernel leading the pass, or fetch it as is, then
+  // run it through the pixel effects.
+  source << "void main() {\n";
+  std::vector<GLuint>::const_iterator it = passEffects.begin();
+  if (it != passEffects.end() &&
+      this->effects[*it].type == PostEffectType::Kernel) {
+    source << "  vec3 sample = " << this->effects[*it].function <<
+      "(frameTexture, fragUv);\n";
+    it++;
+  } else {
+    source << "  vec3 sample = vec3(texture(frameTexture, fragUv));\n";
+  }
+  for (; it != passEffects.end(); it++) {
+    source << "  sample = " << this->effects[*it].function <<
+      "(sample, fragUv);\n";
+  }
+  source << "  color = vec4(sample, 1.0f);\n}\n";
+
+  return source.str();
+}
+
+void PostChain::release() {
+  for (Pass& pass : this->passes) {
+    glDeleteProgram(pass.shader.program);
+  }
+  this->passes.clear();
+
+  for (GLuint i = 0; i < 2; i++) {
+    if (this->textures[i] != 0) {
+      glDeleteTextures(1, &this->textures[i]);
+      glDeleteFramebuffers(1, &this->framebuffers[i]);
+      this->textures[i] = this->framebuffers[i] = 0;
+    }
+  }
+}
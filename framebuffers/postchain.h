@@ -0,0 +1,94 @@
+#ifndef POSTCHAIN_H
+#define POSTCHAIN_H
+
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <GL/glew.h>
+}
+
+#include "shader.h"
+
+// How a post-processing effect reads the frame.
+//
+//   Pixel: vec3 name(vec3 color, vec2 uv), only sees the color the effects
+//     before it left in its own pixel.
+//   Kernel: vec3 name(sampler2D frame, vec2 uv), may read the frame anywhere
+//     around the pixel (blurs, distortions, edge detection).
+enum class PostEffectType {
+  Pixel,
+  Kernel
+};
+
+// Chain of post-processing effects drawn over a frame. Effects are GLSL
+// functions rather than whole shaders so the chain can fuse them: a pass reads
+// the previous result with a kernel effect or a plain texture fetch, then runs
+// every pixel effect after it on the color it got. Only a kernel following
+// other effects starts a new pass, and with it needs an intermediate target,
+// since it has to read their output around the pixel. However many pixel
+// effects are stacked they stay in one full screen pass.
+//
+// Effects may use the uniforms time (seconds) and texelSize (size of a texel
+// of the texture the pass reads), which the chain declares and sets.
+class PostChain {
+  public:
+    // Intermediate targets are width by height.
+    PostChain(GLuint width, GLuint height);
+    ~PostChain();
+
+    PostChain(const PostChain&) = delete;
+    PostChain& operator=(const PostChain&) = delete;
+
+    // Appends an effect defining the named function, its source is read from
+    // the file at path. The same effect may be added more than once, and a
+    // file may define several effects.
+    void add(PostEffectType type, const std::string& function,
+        const GLchar* path);
+
+    // Groups the effects into passes, generates and compiles their shaders and
+    // creates the intermediate targets they need. Has to be called after
+    // adding effects and before drawing.
+    void build();
+
+    // Whether the intermediate targets could be rendered into.
+    bool complete();
+
+    // Runs the passes over the frame texture. The last pass draws into the
+    // framebuffer bound when this is called, the viewport is left alone.
+    void draw(GLuint frameTexture, GLfloat time);
+
+    // Number of full screen passes the effects were fused into.
+    GLuint passCount() const;
+    GLuint effectCount() const;
+  private:
+    struct Effect {
+      PostEffectType type;
+      std::string function;
+      std::string source;
+    };
+
+    // Effects of a pass in order, only the first may be a kernel.
+    struct Pass {
+      std::vector<GLuint> effects;
+      Shader shader;
+    };
+
+    GLuint width;
+    GLuint height;
+    std::vector<Effect> effects;
+    std::vector<Pass> passes;
+
+    // Render targets passes before the last one write into, used in turn.
+    // Zero when the chain doesn't need them.
+    GLuint textures[2];
+    GLuint framebuffers[2];
+
+    // Empty vertex array the full screen triangle is drawn with.
+    GLuint VAO;
+
+    std::string fragmentSource(const std::vector<GLuint>& passEffects);
+    void release();
+};
+
+#endif
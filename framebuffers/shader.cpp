@@ -8,11 +8,23 @@ extern "C" {
 #include <GLFW/glfw3.h>
 }
 
+Shader::Shader() : program(0) {
+}
+
 Shader::Shader(const GLchar* vertexPath, const GLchar* fragmentPath) {
   // Read shader sources into memory.
-  std::string vertexShaderSource = readShader(vertexPath);
-  std::string fragmentShaderSource = readShader(fragmentPath);
+  build(readShader(vertexPath), readShader(fragmentPath));
+}
+
+Shader Shader::fromSource(const std::string& vertexSource,
+    const std::string& fragmentSource) {
+  Shader shader;
+  shader.build(vertexSource, fragmentSource);
+  return shader;
+}
 
+void Shader::build(const std::string& vertexShaderSource,
+    const std::string& fragmentShaderSource) {
   // Compile the vertex shader.
   const char* vertexShaderSourceCStr = vertexShaderSource.c_str();
   GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
@@ -31,8 +43,10 @@ Shader::Shader(const GLchar* vertexPath, const GLchar* fragmentPath) {
   glShaderSource(fragmentShader, 1, &fragmentShaderSourceCStr, nullptr);
   glCompileShader(fragmentShader);
 
-  // Check the fragment shader.
+  // Check the fragment shader. Dump its source too, it may have been
+  // generated.
   if (!checkCompileStatus(fragmentShader)) {
+    std::cerr << fragmentShaderSource << std::endl;
     glfwTerminate();
     exit(1);
   }
@@ -16,12 +16,23 @@ class Shader {
     // shader and a fragment shader.
     Shader(const GLchar* vertexPath, const GLchar* fragmentPath);
 
+    // Creates a shader program from sources in memory rather than files, for
+    // shaders that are generated at runtime.
+    static Shader fromSource(const std::string& vertexSource,
+        const std::string& fragmentSource);
+
     // Activate the shader in the OpenGL state machine. This is simply just a
     // wrapper around glUseProgram using the public program field as input.
     void use();
-  private:
+
     // Reads a shader (or any file for that matter) and puts it into a string.
-    std::string readShader(std::string filepath);
+    static std::string readShader(std::string filepath);
+  private:
+    Shader();
+
+    // Compiles and links the sources into the program.
+    void build(const std::string& vertexShaderSource,
+        const std::string& fragmentShaderSource);
 
     // Used to check if a shader compiled successfully.
     bool checkCompileStatus(GLuint shader);
@@ -0,0 +1,52 @@
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include "globject.h"
+
+namespace {
+  // Uploaded bytes for every live object, keyed by type and id.
+  std::map<std::pair<std::string, GLuint>, size_t> liveObjects;
+  std::mutex liveObjectsMutex;
+}
+
+void trackGLObject(const char* type, GLuint id) {
+  std::lock_guard<std::mutex> lock(liveObjectsMutex);
+  liveObjects[std::make_pair(std::string(type), id)] = 0;
+}
+
+void untrackGLObject(const char* type, GLuint id) {
+  std::lock_guard<std::mutex> lock(liveObjectsMutex);
+  liveObjects.erase(std::make_pair(std::string(type), id));
+}
+
+void setGLObjectBytes(const char* type, GLuint id, size_t bytes) {
+  std::lock_guard<std::mutex> lock(liveObjectsMutex);
+  auto object = liveObjects.find(std::make_pair(std::string(type), id));
+  if (object != liveObjects.end()) {
+    object->second = bytes;
+  }
+}
+
+void reportGLObjects(std::ostream& out) {
+  std::lock_guard<std::mutex> lock(liveObjectsMutex);
+
+  // Sum up the count and bytes per type.
+  std::map<std::string, std::pair<size_t, size_t>> totals;
+  size_t totalBytes = 0;
+  for (auto& object : liveObjects) {
+    std::pair<size_t, size_t>& total = totals[object.first.first];
+    total.first++;
+    total.second += object.second;
+    totalBytes += object.second;
+  }
+
+  out << "Live GL objects:" << std::endl;
+  for (auto& total : totals) {
+    out << "  " << total.first << ": " << total.second.first << " (" <<
+      total.second.second / 1024 << " KiB)" << std::endl;
+  }
+  out << "  total: " << liveObjects.size() << " (" << totalBytes / 1024 <<
+    " KiB)" << std::endl;
+}
@@ -0,0 +1,121 @@
+#ifndef GLOBJECT_H
+#define GLOBJECT_H
+
+#include <cstddef>
+#include <ostream>
+
+extern "C" {
+#include <GL/glew.h>
+}
+
+// Keeps count of every live GL object and how many bytes were uploaded to it,
+// so leaks and memory hogs show up in reportGLObjects.
+void trackGLObject(const char* type, GLuint id);
+void untrackGLObject(const char* type, GLuint id);
+void setGLObjectBytes(const char* type, GLuint id, size_t bytes);
+
+// Dumps the number of live objects and their sizes per type.
+void reportGLObjects(std::ostream& out);
+
+// Owns a single GL object and deletes it when going out of scope. Copying is
+// disallowed since two owners would delete the object twice, ownership can be
+// moved instead. Converts to the raw GLuint so it can be passed to GL as is.
+template <typename Traits>
+class GLObject {
+  public:
+    // Empty handle that owns nothing.
+    GLObject() : id(0) {}
+
+    ~GLObject() {
+      reset();
+    }
+
+    GLObject(const GLObject&) = delete;
+    GLObject& operator=(const GLObject&) = delete;
+
+    GLObject(GLObject&& other) noexcept : id(other.id) {
+      other.id = 0;
+    }
+
+    GLObject& operator=(GLObject&& other) noexcept {
+      if (this != &other) {
+        reset();
+        id = other.id;
+        other.id = 0;
+      }
+      return *this;
+    }
+
+    // Generates a new object of this type.
+    static GLObject create() {
+      GLObject object;
+      object.id = Traits::create();
+      trackGLObject(Traits::name(), object.id);
+      return object;
+    }
+
+    // Records how many bytes of data the object holds for the report.
+    void setBytes(size_t bytes) {
+      setGLObjectBytes(Traits::name(), id, bytes);
+    }
+
+    // Deletes the object, leaving the handle empty.
+    void reset() {
+      if (id != 0) {
+        untrackGLObject(Traits::name(), id);
+        Traits::destroy(id);
+        id = 0;
+      }
+    }
+
+    operator GLuint() const {
+      return id;
+    }
+  private:
+    GLuint id;
+};
+
+struct GLBufferTraits {
+  static const char* name() { return "buffer"; }
+  static GLuint create() { GLuint id; glGenBuffers(1, &id); return id; }
+  static void destroy(GLuint id) { glDeleteBuffers(1, &id); }
+};
+
+struct GLVertexArrayTraits {
+  static const char* name() { return "vertex array"; }
+  static GLuint create() { GLuint id; glGenVertexArrays(1, &id); return id; }
+  static void destroy(GLuint id) { glDeleteVertexArrays(1, &id); }
+};
+
+struct GLTextureTraits {
+  static const char* name() { return "texture"; }
+  static GLuint create() { GLuint id; glGenTextures(1, &id); return id; }
+  static void destroy(GLuint id) { glDeleteTextures(1, &id); }
+};
+
+struct GLFramebufferTraits {
+  static const char* name() { return "framebuffer"; }
+  static GLuint create() { GLuint id; glGenFramebuffers(1, &id); return id; }
+  static void destroy(GLuint id) { glDeleteFramebuffers(1, &id); }
+};
+
+struct GLRenderbufferTraits {
+  static const char* name() { return "renderbuffer"; }
+  static GLuint create() { GLuint id; glGenRenderbuffers(1, &id); return id; }
+  static void destroy(GLuint id) { glDeleteRenderbuffers(1, &id); }
+};
+
+struct GLProgramTraits {
+  static const char* name() { return "program"; }
+  static GLuint create() { return glCreateProgram(); }
+  static void destroy(GLuint id) { glDeleteProgram(id); }
+};
+
+typedef GLObject<GLBufferTraits> GLBuffer;
+typedef GLObject<GLVertexArrayTraits> GLVertexArray;
+typedef GLObject<GLTextureTraits> GLTexture;
+typedef GLObject<GLFramebufferTraits> GLFramebuffer;
+typedef GLObject<GLRenderbufferTraits> GLRenderbuffer;
+typedef GLObject<GLProgramTraits> GLProgram;
+
+#endif
@@ -0,0 +1,23 @@
+#version 330 core
+
+layout (location = 0) in vec3 position;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+// Bounds of the mesh used to decode packed positions. Plain float vertices get
+// an offset of 0 and a scale of 1.
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+// Has to come out bit for bit the same as in vertex.glsl, the lit pass only
+// shades fragments whose depth equals what the prepass wrote.
+invariant gl_Position;
+
+void main() {
+  vec3 localPos = position * positionScale + positionOffset;
+
+  // Apply the object's transform to the vertex.
+  gl_Position = projection * view * model * vec4(localPos, 1.0f);
+}
@@ -15,13 +15,25 @@ uniform mat4 projection;
 // Stripped version of the model matrix without the translation information.
 uniform mat3 normalMatrix;
 
+// Bounds of the mesh used to decode packed positions and uvs. Plain float
+// vertices get an offset of 0 and a scale of 1.
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+uniform vec2 uvOffset;
+uniform vec2 uvScale;
+
+// Must match glsl/depthvertex.glsl exactly for the depth prepass.
+invariant gl_Position;
+
 void main() {
+  vec3 localPos = position * positionScale + positionOffset;
+
   // Get the fragment position by getting the vertex position in world space
   // and letting OpenGL interpolate it (since we are using out).
-  fragPos = vec3(model * vec4(position, 1.0f));
+  fragPos = vec3(model * vec4(localPos, 1.0f));
   fragNormal = normalMatrix * normal;
-  fragUv = vec2(uv.x, uv.y);
+  fragUv = uv * uvScale + uvOffset;
 
   // Apply the object's transform to the vertex.
-  gl_Position = projection * view * model * vec4(position, 1.0f);
+  gl_Position = projection * view * model * vec4(localPos, 1.0f);
 }
@@ -14,6 +14,9 @@ extern "C" {
 #include <SOIL/SOIL.h>
 }
 
+#include "globject.h"
+#include "gputimer.h"
+#include "lighting.h"
 #include "shader.h"
 #include "perspectivecamera.h"
 #include "model.h"
@@ -50,8 +53,15 @@ bool firstMouseEvent = true;
 // Keyboard state.
 bool keys[1024];
 
+// Whether the model is drawn into the depth buffer first so the lit pass only
+// shades the visible fragment of every pixel, toggled with P.
+bool depthPrepass = true;
+
+// Sets up the scene and renders it until the window is closed.
+void run(GLFWwindow* window, int fbWidth, int fbHeight);
+
 // Utility functions.
-GLuint loadTexture(std::string filepath);
+GLTexture loadTexture(std::string filepath);
 void move(GLfloat delta);
 GLfloat easeOutQuart(GLfloat t, GLfloat b, GLfloat c, GLfloat d);
 
@@ -106,15 +116,32 @@ int main() {
   // prevent overlapping polygon artifacts.
   glEnable(GL_DEPTH_TEST);
 
+  // Everything owning GL objects lives in run so it gets deleted before the
+  // context goes away with glfwTerminate.
+  run(window, fbWidth, fbHeight);
+
+  // Terminate GLFW and clean any resources before exiting.
+  glfwTerminate();
+
+  return 0;
+}
+
+void run(GLFWwindow* window, int fbWidth, int fbHeight) {
   // Read and compile the vertex and fragment shaders using
   // the shader helper class.
   Shader shader("glsl/vertex.glsl", "glsl/fragment.glsl");
   Shader lampShader("glsl/lampvertex.glsl", "glsl/lampfragment.glsl");
-  Model crysisModel("assets/nanosuit.obj");
+  Shader depthShader("glsl/depthvertex.glsl", "glsl/depthfragment.glsl");
 
-  GLuint containerTexture = loadTexture("assets/container2.png");
-  GLuint containerSpecular = loadTexture("assets/container2_specular.png");
-  GLuint containerEmission = loadTexture("assets/matrix.jpg");
+  // Import the model in the background so the window renders right away. The
+  // meshes pop in as they finish loading. Nothing reads the geometry back, so
+  // only the GPU copy is kept, plus the positions on their own for the depth
+  // prepass.
+  Model crysisModel("assets/nanosuit.obj", true, CpuGeometry::Release, true);
+
+  GLTexture containerTexture = loadTexture("assets/container2.png");
+  GLTexture containerSpecular = loadTexture("assets/container2_specular.png");
+  GLTexture containerEmission = loadTexture("assets/matrix.jpg");
 
   // Container mesh data.
   GLfloat vertices[] = {
@@ -177,14 +204,14 @@ int main() {
 
   // Create a VBO to store the vertex data, an EBO to store indice data, and
   // create a VAO to retain our vertex attribute pointers.
-  GLuint VBO, VAO;
-  glGenVertexArrays(1, &VAO);
-  glGenBuffers(1, &VBO);
+  GLVertexArray VAO = GLVertexArray::create();
+  GLBuffer VBO = GLBuffer::create();
 
   // Fill the VBO and set vertex attributes.
   glBindVertexArray(VAO);
   glBindBuffer(GL_ARRAY_BUFFER, VBO);
   glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+  VBO.setBytes(sizeof(vertices));
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)0);
   glEnableVertexAttribArray(0);
   glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
@@ -194,8 +221,7 @@ int main() {
   glBindVertexArray(0);
 
   // Create a lamp box thing using the existing container VBO.
-  GLuint lightVAO;
-  glGenVertexArrays(1, &lightVAO);
+  GLVertexArray lightVAO = GLVertexArray::create();
 
   // Use the container's VBO and set vertex attributes.
   glBindVertexArray(lightVAO);
@@ -228,6 +254,22 @@ int main() {
     glm::vec3( 0.0f,  0.0f, -3.0f)
   };
 
+  // The lights share one attenuation and are at most white, so they all
+  // reach equally far.
+  const GLfloat attenuationRadius = lightRadius(1.0f, 0.09f, 0.032f, 1.0f);
+
+  // Times the depth prepass and the lit model on the GPU.
+  GpuTimer prepassTimer;
+  GpuTimer lightingTimer;
+
+  // Last reported time of both passes together without and with the depth
+  // prepass, so the two can be compared after toggling it.
+  double frameMilliseconds[2] = { 0.0, 0.0 };
+  bool timedPrepass = depthPrepass;
+
+  bool reportedObjects = false;
+  GLfloat lastReport = 0.0f;
+
   // Render loop.
   while (!glfwWindowShouldClose(window)) {
     GLfloat currentFrame = glfwGetTime();
@@ -252,6 +294,45 @@ int main() {
     camera.fov = easeOutQuart(fovTime, startFov, (startFov - targetFov) * -1, limitTime);
     camera.update();
 
+    // Don't mix timings of both modes after the prepass was toggled.
+    if (depthPrepass != timedPrepass) {
+      prepassTimer.reset();
+      lightingTimer.reset();
+      timedPrepass = depthPrepass;
+      lastReport = currentFrame;
+    }
+
+    // The model stays at the origin.
+    model = glm::mat4();
+
+    // Whatever parts of the magic man are loaded at least.
+    crysisModel.update();
+
+    // Back faces are culled by GL anyway, so meshlets facing away from the
+    // camera can be skipped before their vertices are even transformed. The
+    // lamp cubes aren't wound consistently so culling is only on for the
+    // model.
+    glEnable(GL_CULL_FACE);
+
+    // Lay down the depth of the model without any shading, the lit pass then
+    // only passes the depth test where it matches. Both passes cull the
+    // same meshlets as they see the same camera and transform.
+    if (depthPrepass) {
+      depthShader.use();
+      glUniformMatrix4fv(glGetUniformLocation(depthShader.program, "view"), 1,
+          GL_FALSE, glm::value_ptr(camera.view));
+      glUniformMatrix4fv(glGetUniformLocation(depthShader.program,
+            "projection"), 1, GL_FALSE, glm::value_ptr(camera.projection));
+      glUniformMatrix4fv(glGetUniformLocation(depthShader.program, "model"),
+          1, GL_FALSE, glm::value_ptr(model));
+
+      prepassTimer.begin();
+      glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+      crysisModel.drawDepth(depthShader, camera, model);
+      glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+      prepassTimer.end();
+    }
+
     shader.use();
 
     // Pass the view and projection matrices from the camera.
@@ -277,6 +358,7 @@ int main() {
     glUniform1f(glGetUniformLocation(shader.program, "pointLights[0].constant"), 1.0f);
     glUniform1f(glGetUniformLocation(shader.program, "pointLights[0].linear"), 0.09);
     glUniform1f(glGetUniformLocation(shader.program, "pointLights[0].quadratic"), 0.032);
+    glUniform1f(glGetUniformLocation(shader.program, "pointLights[0].radius"), attenuationRadius);
 
     // Point light 2
     glUniform3f(glGetUniformLocation(shader.program, "pointLights[1].position"), pointLightPositions[1].x, pointLightPositions[1].y, pointLightPositions[1].z);
@@ -286,6 +368,7 @@ int main() {
     glUniform1f(glGetUniformLocation(shader.program, "pointLights[1].constant"), 1.0f);
     glUniform1f(glGetUniformLocation(shader.program, "pointLights[1].linear"), 0.09);
     glUniform1f(glGetUniformLocation(shader.program, "pointLights[1].quadratic"), 0.032);
+    glUniform1f(glGetUniformLocation(shader.program, "pointLights[1].radius"), attenuationRadius);
 
     // Point light 3
     glUniform3f(glGetUniformLocation(shader.program, "pointLights[2].position"), pointLightPositions[2].x, pointLightPositions[2].y, pointLightPositions[2].z);
@@ -295,6 +378,7 @@ int main() {
     glUniform1f(glGetUniformLocation(shader.program, "pointLights[2].constant"), 1.0f);
     glUniform1f(glGetUniformLocation(shader.program, "pointLights[2].linear"), 0.09);
     glUniform1f(glGetUniformLocation(shader.program, "pointLights[2].quadratic"), 0.032);
+    glUniform1f(glGetUniformLocation(shader.program, "pointLights[2].radius"), attenuationRadius);
 
     // Point light 4
     glUniform3f(glGetUniformLocation(shader.program, "pointLights[3].position"), pointLightPositions[3].x, pointLightPositions[3].y, pointLightPositions[3].z);
@@ -304,6 +388,7 @@ int main() {
     glUniform1f(glGetUniformLocation(shader.program, "pointLights[3].constant"), 1.0f);
     glUniform1f(glGetUniformLocation(shader.program, "pointLights[3].linear"), 0.09);
     glUniform1f(glGetUniformLocation(shader.program, "pointLights[3].quadratic"), 0.032);
+    glUniform1f(glGetUniformLocation(shader.program, "pointLights[3].radius"), attenuationRadius);
 
     // Sport light 1
     glUniform3f(glGetUniformLocation(shader.program, "spotLights[0].position"), camera.position.x, camera.position.y, camera.position.z);
@@ -314,17 +399,15 @@ int main() {
     glUniform1f(glGetUniformLocation(shader.program, "spotLights[0].constant"), 1.0f);
     glUniform1f(glGetUniformLocation(shader.program, "spotLights[0].linear"), 0.09);
     glUniform1f(glGetUniformLocation(shader.program, "spotLights[0].quadratic"), 0.032);
+    glUniform1f(glGetUniformLocation(shader.program, "spotLights[0].radius"), attenuationRadius);
     glUniform1f(glGetUniformLocation(shader.program, "spotLights[0].cutoff"), glm::cos(glm::radians(12.5f)));
     glUniform1f(glGetUniformLocation(shader.program, "spotLights[0].outerCutoff"), glm::cos(glm::radians(15.5f)));
 
     // Pass material values.
+    // The diffuse and specular arrays are bound by the meshes.
     GLuint materialShininess = glGetUniformLocation(shader.program, "material.shininess");
-    GLuint materialDiffuse   = glGetUniformLocation(shader.program, "material.diffuse");
-    GLuint materialSpecular  = glGetUniformLocation(shader.program, "material.specular");
     GLuint materialEmission  = glGetUniformLocation(shader.program, "material.emission");
     glUniform1f(materialShininess, 64.0f);
-    glUniform1i(materialDiffuse, 0);
-    glUniform1i(materialSpecular, 1);
     glUniform1i(materialEmission, 2);
 
     // Misc values.
@@ -340,7 +423,6 @@ int main() {
     glBindTexture(GL_TEXTURE_2D, containerEmission);
 
     // Apply world transformations.
-    model = glm::mat4();
     GLuint modelMatrix = glGetUniformLocation(shader.program, "model");
     glUniformMatrix4fv(modelMatrix, 1, GL_FALSE, glm::value_ptr(model));
 
@@ -349,8 +431,48 @@ int main() {
     GLuint normalMatrix = glGetUniformLocation(shader.program, "normalMatrix");
     glUniformMatrix3fv(normalMatrix, 1, GL_FALSE, glm::value_ptr(normal));
 
-    // Draw the magic man!
-    crysisModel.draw(shader);
+    // Draw the magic man! With the prepass the depth buffer already holds
+    // the nearest surfaces, so only fragments with exactly that depth get
+    // shaded and nothing needs to be written.
+    if (depthPrepass) {
+      glDepthFunc(GL_EQUAL);
+      glDepthMask(GL_FALSE);
+    }
+    lightingTimer.begin();
+    crysisModel.draw(shader, camera, model);
+    lightingTimer.end();
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+    glDisable(GL_CULL_FACE);
+
+    // Show how much of the model survived culling and how long it took to
+    // draw every second, and how long it took the last time with the
+    // prepass the other way around.
+    if (currentFrame - lastReport >= 1.0f) {
+      frameMilliseconds[depthPrepass] = prepassTimer.milliseconds() +
+        lightingTimer.milliseconds();
+
+      std::ostringstream title;
+      title << "LearnGL (" << crysisModel.drawnTriangles << " / " <<
+        crysisModel.totalTriangles << " triangles, lighting " <<
+        lightingTimer.milliseconds() << " ms";
+      if (depthPrepass) {
+        title << " + prepass " << prepassTimer.milliseconds() << " ms";
+      }
+      title << ", prepass on " << frameMilliseconds[true] << " ms / off " <<
+        frameMilliseconds[false] << " ms)";
+      glfwSetWindowTitle(window, title.str().c_str());
+      prepassTimer.reset();
+      lightingTimer.reset();
+      lastReport = currentFrame;
+    }
+
+    // Show what ended up on the GPU once everything streamed in.
+    if (!reportedObjects && crysisModel.loaded()) {
+      crysisModel.reportMemory(std::cout);
+      reportGLObjects(std::cout);
+      reportedObjects = true;
+    }
 
     // Bind the VAO and shader.
     glBindVertexArray(lightVAO);
@@ -379,21 +501,11 @@ int main() {
     // Swap buffers used for double buffering.
     glfwSwapBuffers(window);
   }
-
-  // Properly deallocate the VBO and VAO.
-  glDeleteVertexArrays(1, &VAO);
-  glDeleteBuffers(1, &VBO);
-
-  // Terminate GLFW and clean any resources before exiting.
-  glfwTerminate();
-
-  return 0;
 }
 
-GLuint loadTexture(std::string filepath) {
+GLTexture loadTexture(std::string filepath) {
   // Generate the texture on the OpenGL side and bind it.
-  GLuint texture;
-  glGenTextures(1, &texture);
+  GLTexture texture = GLTexture::create();
   glBindTexture(GL_TEXTURE_2D, texture);
 
   // Set some parameters for the bound texture. Use GL_LINEAR to get a gaussian
@@ -409,6 +521,7 @@ GLuint loadTexture(std::string filepath) {
   // mipmaps for it for perf.
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
   glGenerateMipmap(GL_TEXTURE_2D);
+  texture.setBytes(width * height * 3 * 4 / 3);
 
   // Free the image and unbind the texture.
   SOIL_free_image_data(image);
@@ -448,6 +561,11 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mode
   if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
     glfwSetWindowShouldClose(window, GL_TRUE);
   }
+
+  // Switch the depth prepass on and off.
+  if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+    depthPrepass = !depthPrepass;
+  }
 }
 
 void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
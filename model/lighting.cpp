@@ -0,0 +1,19 @@
+#include "lighting.h"
+
+#include <math.h>
+
+GLfloat lightRadius(GLfloat constant, GLfloat linear, GLfloat quadratic,
+    GLfloat intensity) {
+  // Solve intensity / (constant + linear * d + quadratic * d^2) = cutoff for
+  // the distance d.
+  GLfloat falloff = intensity / kLightCutoff - constant;
+  if (falloff <= 0.0f) {
+    return 0.0f;
+  }
+  if (quadratic <= 0.0f) {
+    return linear > 0.0f ? falloff / linear : INFINITY;
+  }
+
+  return (-linear + sqrtf(linear * linear + 4.0f * quadratic * falloff)) /
+    (2.0f * quadratic);
+}
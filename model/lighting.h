@@ -0,0 +1,18 @@
+#ifndef LIGHTING_H
+#define LIGHTING_H
+
+extern "C" {
+#include <GL/glew.h>
+}
+
+// Light contributions dimmer than this (in 8-bit color steps) are treated as
+// zero, which is what gives point and spot lights a finite radius.
+const GLfloat kLightCutoff = 5.0f / 256.0f;
+
+// Distance at which the constant/linear/quadratic attenuation of a light whose
+// brightest color channel is intensity falls below kLightCutoff. Passed to the
+// shaders as the light radius so fragments past it can skip the light.
+GLfloat lightRadius(GLfloat constant, GLfloat linear, GLfloat quadratic,
+    GLfloat intensity);
+
+#endif
@@ -1,35 +1,285 @@
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 
 #include "mesh.h"
 
+// Texture unit the material arrays are bound to. It stays clear of the units
+// the demo binds its plain 2D textures to.
+const GLuint kMaterialUnit = 3;
+
+namespace {
+  // Maps a value in [0, 1] to the full unsigned 16-bit range.
+  GLushort packUnorm16(GLfloat value) {
+    value = std::min(std::max(value, 0.0f), 1.0f);
+    return (GLushort)std::lround(value * 65535.0f);
+  }
+
+  // Maps a value in [-1, 1] to a 10-bit two's complement integer.
+  GLuint packSnorm10(GLfloat value) {
+    value = std::min(std::max(value, -1.0f), 1.0f);
+    return (GLuint)std::lround(value * 511.0f) & 0x3ff;
+  }
+}
+
+VertexQuantization quantizeVertices(const std::vector<Vertex>& vertices,
+    std::vector<PackedVertex>& packed) {
+  VertexQuantization quantization;
+  packed.resize(vertices.size());
+  if (vertices.empty()) {
+    quantization.positionOffset = glm::vec3(0.0f);
+    quantization.positionScale = glm::vec3(1.0f);
+    quantization.uvOffset = glm::vec2(0.0f);
+    quantization.uvScale = glm::vec2(1.0f);
+    return quantization;
+  }
+
+  // Find the bounds of the positions and uvs, those become the range the
+  // 16-bit values are spread over.
+  glm::vec3 minPosition = vertices[0].position;
+  glm::vec3 maxPosition = vertices[0].position;
+  glm::vec2 minUv = vertices[0].uv;
+  glm::vec2 maxUv = vertices[0].uv;
+  for (GLuint i = 1; i < vertices.size(); i++) {
+    minPosition = glm::min(minPosition, vertices[i].position);
+    maxPosition = glm::max(maxPosition, vertices[i].position);
+    minUv = glm::min(minUv, vertices[i].uv);
+    maxUv = glm::max(maxUv, vertices[i].uv);
+  }
+
+  // Flat axes still need a non-zero scale to divide by.
+  quantization.positionOffset = minPosition;
+  quantization.positionScale = glm::max(maxPosition - minPosition,
+      glm::vec3(1e-6f));
+  quantization.uvOffset = minUv;
+  quantization.uvScale = glm::max(maxUv - minUv, glm::vec2(1e-6f));
+
+  for (GLuint i = 0; i < vertices.size(); i++) {
+    const Vertex& vertex = vertices[i];
+    PackedVertex& out = packed[i];
+
+    glm::vec3 position = (vertex.position - quantization.positionOffset) /
+      quantization.positionScale;
+    out.position[0] = packUnorm16(position.x);
+    out.position[1] = packUnorm16(position.y);
+    out.position[2] = packUnorm16(position.z);
+    out.position[3] = 0;
+
+    // Normals only need to be unit length before packing, the shader
+    // normalizes again after interpolation anyway.
+    glm::vec3 normal = vertex.normal;
+    GLfloat length = glm::length(normal);
+    if (length > 0.0f) {
+      normal /= length;
+    }
+    out.normal = packSnorm10(normal.x) | packSnorm10(normal.y) << 10 |
+      packSnorm10(normal.z) << 20;
+
+    glm::vec2 uv = (vertex.uv - quantization.uvOffset) / quantization.uvScale;
+    out.uv[0] = packUnorm16(uv.x);
+    out.uv[1] = packUnorm16(uv.y);
+  }
+
+  return quantization;
+}
+
 Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices,
   std::vector<Texture> textures) {
 
-  this->vertices = vertices;
-  this->indices = indices;
-  this->textures = textures;
+  this->vertices = std::move(vertices);
+  this->indices = std::move(indices);
+  this->textures = std::move(textures);
+  this->packed = false;
+
+  // Plain float vertices decode with the identity transform.
+  quantization.positionOffset = glm::vec3(0.0f);
+  quantization.positionScale = glm::vec3(1.0f);
+  quantization.uvOffset = glm::vec2(0.0f);
+  quantization.uvScale = glm::vec2(1.0f);
+
+  setup();
+}
+
+Mesh::Mesh(std::vector<PackedVertex> packedVertices,
+  VertexQuantization quantization, std::vector<GLuint> indices,
+  std::vector<Texture> textures) {
+
+  this->packedVertices = std::move(packedVertices);
+  this->quantization = quantization;
+  this->indices = std::move(indices);
+  this->textures = std::move(textures);
+  this->packed = true;
 
   setup();
 }
 
+GLuint Mesh::triangleCount() const {
+  return indexCount / 3;
+}
+
+size_t Mesh::vertexBytes() const {
+  return vertexBufferBytes;
+}
+
+size_t Mesh::indexBytes() const {
+  return indexBufferBytes;
+}
+
+size_t Mesh::gpuBytes() const {
+  return vertexBufferBytes + indexBufferBytes + positionBufferBytes;
+}
+
+size_t Mesh::cpuBytes() const {
+  return vertices.capacity() * sizeof(Vertex) +
+    packedVertices.capacity() * sizeof(PackedVertex) +
+    indices.capacity() * sizeof(GLuint) +
+    positions.capacity() * sizeof(glm::vec3);
+}
+
+void Mesh::releaseGeometry(bool keepPositions) {
+  if (vertices.empty() && packedVertices.empty()) {
+    return;
+  }
+
+  if (keepPositions) {
+    positions.resize(vertexCount);
+    for (GLuint i = 0; i < vertexCount; i++) {
+      if (packed) {
+        const GLushort* position = packedVertices[i].position;
+        positions[i] = glm::vec3(position[0], position[1], position[2]) /
+          65535.0f * quantization.positionScale + quantization.positionOffset;
+      } else {
+        positions[i] = vertices[i].position;
+      }
+    }
+  } else {
+    std::vector<GLuint>().swap(indices);
+  }
+
+  // Swap with empty vectors since clear keeps the memory around.
+  std::vector<Vertex>().swap(vertices);
+  std::vector<PackedVertex>().swap(packedVertices);
+}
+
+void Mesh::createPositionStream() {
+  if (vertices.empty() && packedVertices.empty()) {
+    return;
+  }
+
+  depthVAO = GLVertexArray::create();
+  positionVBO = GLBuffer::create();
+
+  glBindVertexArray(depthVAO);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+  glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+
+  if (packed) {
+    // Keep the padding component so every position starts on 4 bytes.
+    std::vector<GLushort> positions(vertexCount * 4);
+    for (GLuint i = 0; i < vertexCount; i++) {
+      std::copy(packedVertices[i].position, packedVertices[i].position + 4,
+        &positions[i * 4]);
+    }
+    positionStride = 4 * sizeof(GLushort);
+    positionBufferBytes = positions.size() * sizeof(GLushort);
+    glBufferData(GL_ARRAY_BUFFER, positionBufferBytes, &positions[0],
+      GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, positionStride,
+      (GLvoid*)0);
+  } else {
+    std::vector<glm::vec3> positions(vertexCount);
+    for (GLuint i = 0; i < vertexCount; i++) {
+      positions[i] = vertices[i].position;
+    }
+    positionStride = sizeof(glm::vec3);
+    positionBufferBytes = positions.size() * sizeof(glm::vec3);
+    glBufferData(GL_ARRAY_BUFFER, positionBufferBytes, &positions[0],
+      GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, positionStride,
+      (GLvoid*)0);
+  }
+  glEnableVertexAttribArray(0);
+  positionVBO.setBytes(positionBufferBytes);
+
+  glBindVertexArray(0);
+}
+
 void Mesh::setup() {
+  vertexCount = packed ? packedVertices.size() : vertices.size();
+  indexCount = indices.size();
+  positionStride = 0;
+  positionBufferBytes = 0;
+
+  // Find the bounds, for packed vertices the quantization range is the box.
+  if (packed) {
+    boundsMin = quantization.positionOffset;
+    boundsMax = quantization.positionOffset + quantization.positionScale;
+  } else if (!vertices.empty()) {
+    boundsMin = boundsMax = vertices[0].position;
+    for (GLuint i = 1; i < vertices.size(); i++) {
+      boundsMin = glm::min(boundsMin, vertices[i].position);
+      boundsMax = glm::max(boundsMax, vertices[i].position);
+    }
+  } else {
+    boundsMin = boundsMax = glm::vec3(0.0f);
+  }
+
   // Generate the buffers needed for the vertices and indices, and the vertex
   // array object for defining how data should be passed to the shader.
-  glGenVertexArrays(1, &VAO);
-  glGenBuffers(1, &VBO);
-  glGenBuffers(1, &EBO);
+  VAO = GLVertexArray::create();
+  VBO = GLBuffer::create();
+  EBO = GLBuffer::create();
 
   glBindVertexArray(VAO);
 
-  // Fill the VBO with the vertex data.
+  // Fill the EBO with the indice data. Narrow the indices to 16 bits when
+  // the vertex count allows it, which halves the index buffer.
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+  if (vertexCount <= kMaxShortIndexVertices) {
+    indexType = GL_UNSIGNED_SHORT;
+    std::vector<GLushort> shortIndices(indices.begin(), indices.end());
+    indexBufferBytes = shortIndices.size() * sizeof(GLushort);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBufferBytes, &shortIndices[0],
+      GL_STATIC_DRAW);
+  } else {
+    indexType = GL_UNSIGNED_INT;
+    indexBufferBytes = indices.size() * sizeof(GLuint);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBufferBytes, &indices[0],
+      GL_STATIC_DRAW);
+  }
+  EBO.setBytes(indexBufferBytes);
+
   glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0],
-    GL_STATIC_DRAW);
 
-  // Fill the EBO with the indice data.
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint),
-    &indices[0], GL_STATIC_DRAW);
+  if (packed) {
+    vertexBufferBytes = packedVertices.size() * sizeof(PackedVertex);
+    glBufferData(GL_ARRAY_BUFFER, vertexBufferBytes, &packedVertices[0],
+      GL_STATIC_DRAW);
+    VBO.setBytes(vertexBufferBytes);
+
+    // The normalized flag turns the integers back into [0, 1] (or [-1, 1] for
+    // the normal) floats, so the shader only has to apply the bounds.
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE,
+      sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, position));
+    glEnableVertexAttribArray(0);
+
+    glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE,
+      sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, normal));
+    glEnableVertexAttribArray(1);
+
+    glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE,
+      sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, uv));
+    glEnableVertexAttribArray(2);
+
+    glBindVertexArray(0);
+    return;
+  }
+
+  // Fill the VBO with the vertex data.
+  vertexBufferBytes = vertices.size() * sizeof(Vertex);
+  glBufferData(GL_ARRAY_BUFFER, vertexBufferBytes, &vertices[0],
+    GL_STATIC_DRAW);
+  VBO.setBytes(vertexBufferBytes);
 
   // Vertex position data pointer.
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
@@ -49,40 +299,128 @@ void Mesh::setup() {
   glBindVertexArray(0);
 }
 
-void Mesh::draw(Shader shader) {
-  // Index counters for the different texture types.
-  GLuint diffuseIndex = 0;
-  GLuint specularIndex = 0;
-  GLuint emissionIndex = 0;
+void Mesh::draw(const Shader& shader, MaterialBinding& binding) {
+  bindMaterial(shader, binding);
 
-  for (GLuint i = 0; i < textures.size(); i++) {
-    std::string index;
-    std::string name = textures[i].type;
-
-    // Get the string representation of the current texture's index depending on
-    // the type of texture.
-    if (name == "texture_diffuse") {
-      index = std::to_string(++diffuseIndex);
-    } else if (name == "texture_specular") {
-      index = std::to_string(++specularIndex);
-    } else if (name == "texture_emission") {
-      index += std::to_string(++emissionIndex);
-    } else {
+  // Draw the mesh in it's glory.
+  glBindVertexArray(VAO);
+  glDrawElements(GL_TRIANGLES, indexCount, indexType, 0);
+  glBindVertexArray(0);
+}
+
+GLuint Mesh::draw(const Shader& shader, const glm::vec3& cameraPosition,
+  const Frustum& frustum, MaterialBinding& binding) {
+  if (meshlets.empty()) {
+    draw(shader, binding);
+    return indexCount / 3;
+  }
+
+  bindMaterial(shader, binding);
+  glBindVertexArray(VAO);
+  GLuint drawnTriangles = drawMeshlets(cameraPosition, frustum);
+  glBindVertexArray(0);
+
+  return drawnTriangles;
+}
+
+void Mesh::drawDepth(const Shader& shader) {
+  bindPositionTransform(shader);
+
+  glBindVertexArray(depthVAO != 0 ? depthVAO : VAO);
+  glDrawElements(GL_TRIANGLES, indexCount, indexType, 0);
+  glBindVertexArray(0);
+}
+
+GLuint Mesh::drawDepth(const Shader& shader, const glm::vec3& cameraPosition,
+  const Frustum& frustum) {
+  if (meshlets.empty()) {
+    drawDepth(shader);
+    return indexCount / 3;
+  }
+
+  bindPositionTransform(shader);
+  glBindVertexArray(depthVAO != 0 ? depthVAO : VAO);
+  GLuint drawnTriangles = drawMeshlets(cameraPosition, frustum);
+  glBindVertexArray(0);
+
+  return drawnTriangles;
+}
+
+GLuint Mesh::drawMeshlets(const glm::vec3& cameraPosition,
+  const Frustum& frustum) {
+  // Meshlets are stored back to back in the index buffer, so runs of visible
+  // ones are merged into a single draw.
+  size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) :
+    sizeof(GLuint);
+  GLuint drawnIndices = 0;
+  GLuint runStart = 0;
+  GLuint runCount = 0;
+
+  for (GLuint i = 0; i <= meshlets.size(); i++) {
+    bool visible = i < meshlets.size() &&
+      !cullMeshlet(meshlets[i], cameraPosition, frustum);
+    if (visible && runCount > 0 &&
+        runStart + runCount == meshlets[i].indexOffset) {
+      runCount += meshlets[i].indexCount;
       continue;
     }
 
-    // Set the material value for the given type to the correct index.
-    glActiveTexture(GL_TEXTURE0 + i);
-    glBindTexture(GL_TEXTURE_2D, textures[i].id);
-    glUniform1f(glGetUniformLocation(shader.program,
-      ("material." + name + index).c_str()), i);
+    if (runCount > 0) {
+      glDrawElements(GL_TRIANGLES, runCount, indexType,
+        (GLvoid*)(runStart * indexSize));
+      drawnIndices += runCount;
+      runCount = 0;
+    }
+
+    if (visible) {
+      runStart = meshlets[i].indexOffset;
+      runCount = meshlets[i].indexCount;
+    }
+  }
+
+  return drawnIndices / 3;
+}
+
+void Mesh::bindMaterial(const Shader& shader, MaterialBinding& binding) {
+  // Materials are packed into a single texture with the specular intensity in
+  // the alpha channel, so only the first diffuse texture is used. Meshes
+  // without one get the placeholder, whatever was drawn before them.
+  GLuint array = binding.placeholder;
+  GLuint layer = 0;
+  for (GLuint i = 0; i < textures.size(); i++) {
+    if (textures[i].type == "texture_diffuse") {
+      array = textures[i].id;
+      layer = textures[i].layer;
+      break;
+    }
   }
 
-  // Bind back to the default texture unit.
-  glActiveTexture(GL_TEXTURE0);
+  // Rebind the array only when it differs from the last mesh's.
+  if (array != binding.array) {
+    glActiveTexture(GL_TEXTURE0 + kMaterialUnit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+    binding.array = array;
 
-  // Draw the mesh in it's glory.
-  glBindVertexArray(VAO);
-  glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-  glBindVertexArray(0);
+    // Bind back to the default texture unit.
+    glActiveTexture(GL_TEXTURE0);
+  }
+
+  glUniform1i(glGetUniformLocation(shader.program, "material.diffuseArray"),
+    kMaterialUnit);
+  glUniform1f(glGetUniformLocation(shader.program, "material.diffuseLayer"),
+    layer);
+
+  // Pass the transform decoding the vertex data.
+  bindPositionTransform(shader);
+  glUniform2fv(glGetUniformLocation(shader.program, "uvOffset"), 1,
+    &quantization.uvOffset.x);
+  glUniform2fv(glGetUniformLocation(shader.program, "uvScale"), 1,
+    &quantization.uvScale.x);
+}
+
+void Mesh::bindPositionTransform(const Shader& shader) {
+  glUniform3fv(glGetUniformLocation(shader.program, "positionOffset"), 1,
+    &quantization.positionOffset.x);
+  glUniform3fv(glGetUniformLocation(shader.program, "positionScale"), 1,
+    &quantization.positionScale.x);
 }
@@ -11,6 +11,8 @@ extern "C" {
 #include <GL/glew.h>
 }
 
+#include "globject.h"
+#include "meshlet.h"
 #include "shader.h"
 
 struct Vertex {
@@ -19,12 +21,52 @@ struct Vertex {
   glm::vec2 uv;
 };
 
+// Meshes with at most this many vertices are drawn with 16-bit indices, larger
+// ones are split on import to fit.
+const GLuint kMaxShortIndexVertices = 65536;
+
+// Compact 16 byte version of Vertex. Positions and uvs are 16-bit unsigned
+// normalized values inside the bounds of their mesh, normals are signed
+// normalized 10:10:10:2. The vertex shader scales them back with the mesh's
+// VertexQuantization.
+struct PackedVertex {
+  GLushort position[4]; // The fourth component only pads to 8 bytes.
+  GLuint normal;
+  GLushort uv[2];
+};
+
+// Transform from the normalized [0, 1] packed values back to the original
+// ones, value = packed * scale + offset.
+struct VertexQuantization {
+  glm::vec3 positionOffset;
+  glm::vec3 positionScale;
+  glm::vec2 uvOffset;
+  glm::vec2 uvScale;
+};
+
+// Packs the vertices into the compact format and returns the transform needed
+// to decode them.
+VertexQuantization quantizeVertices(const std::vector<Vertex>& vertices,
+    std::vector<PackedVertex>& packed);
+
+// A material texture, stored as one layer of a GL_TEXTURE_2D_ARRAY.
 struct Texture {
   GLuint id;
+  GLuint layer;
   std::string type;
   aiString path;
 };
 
+// Texture array bound to the material unit by the previous draw, and the
+// placeholder array meshes without a material sample. Consecutive meshes
+// sharing an array then only have to change the layer uniform.
+struct MaterialBinding {
+  GLuint array;
+  GLuint placeholder;
+
+  MaterialBinding(GLuint placeholder) : array(0), placeholder(placeholder) {}
+};
+
 class Mesh {
   public:
     // Generic raw mesh data.
@@ -32,17 +74,105 @@ class Mesh {
     std::vector<GLuint> indices;
     std::vector<Texture> textures;
 
+    // Compact vertex data, used instead of vertices when packed is set.
+    std::vector<PackedVertex> packedVertices;
+    VertexQuantization quantization;
+    bool packed;
+
     Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices,
       std::vector<Texture> textures);
+    Mesh(std::vector<PackedVertex> packedVertices,
+      VertexQuantization quantization, std::vector<GLuint> indices,
+      std::vector<Texture> textures);
+
+    // Bounding box of the mesh in model space. Kept after the geometry is
+    // released for culling.
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+
+    // Clusters of the index buffer that can be culled on their own. Empty
+    // when the mesh wasn't split into meshlets.
+    std::vector<Meshlet> meshlets;
+
+    // Model space positions kept for culling or picking when the rest of the
+    // vertex data was released. Indexed by indices.
+    std::vector<glm::vec3> positions;
+
+    // Number of triangles in the index buffer on the GPU.
+    GLuint triangleCount() const;
+
+    // Sizes of the vertex and index buffers on the GPU in bytes, as handed to
+    // glBufferData.
+    size_t vertexBytes() const;
+    size_t indexBytes() const;
+
+    // Size of all the geometry on the GPU and in system memory in bytes.
+    size_t gpuBytes() const;
+    size_t cpuBytes() const;
+
+    // Frees the CPU copies of the geometry once it lives on the GPU. With
+    // keepPositions the indices and unpacked positions stay around.
+    void releaseGeometry(bool keepPositions);
+
+    // Uploads a second, tightly packed copy of just the positions with a
+    // vertex array reading only those, for depth only passes. They then fetch
+    // 12 bytes per vertex instead of 32, or 8 instead of 16 when packed. Must
+    // be called before the geometry is released.
+    void createPositionStream();
 
     // Draw the mesh with the given shader program.
-    void draw(Shader shader);
+    void draw(const Shader& shader, MaterialBinding& binding);
+
+    // Draws only the meshlets that are in the frustum and not facing away
+    // from the camera, both given in model space. Returns the number of
+    // triangles drawn.
+    GLuint draw(const Shader& shader, const glm::vec3& cameraPosition,
+      const Frustum& frustum, MaterialBinding& binding);
+
+    // Same as draw but for depth only passes: no material is bound and the
+    // position stream is read when there is one. The shader only gets the
+    // uniforms decoding the positions.
+    void drawDepth(const Shader& shader);
+    GLuint drawDepth(const Shader& shader, const glm::vec3& cameraPosition,
+      const Frustum& frustum);
   private:
-    // OpenGL state data.
-    GLuint VAO, VBO, EBO;
+    // OpenGL state data, deleted along with the mesh. Meshes can be moved but
+    // not copied.
+    GLVertexArray VAO;
+    GLBuffer VBO, EBO;
+
+    // Position stream and the vertex array reading it with the same EBO,
+    // empty unless createPositionStream was called.
+    GLVertexArray depthVAO;
+    GLBuffer positionVBO;
+    GLuint positionStride;
+
+    // GL_UNSIGNED_SHORT when every vertex can be addressed with 16 bits,
+    // GL_UNSIGNED_INT otherwise.
+    GLenum indexType;
+
+    // Element counts of the GPU buffers, which stay valid after the vectors
+    // are released.
+    GLuint vertexCount;
+    GLuint indexCount;
+
+    // Bytes uploaded into VBO, EBO and positionVBO, padding included.
+    size_t vertexBufferBytes;
+    size_t indexBufferBytes;
+    size_t positionBufferBytes;
 
     // Works with OpenGL to create buffers to store the mesh data on the GPU.
     void setup();
+
+    // Binds the textures and passes the per mesh uniforms.
+    void bindMaterial(const Shader& shader, MaterialBinding& binding);
+    void bindPositionTransform(const Shader& shader);
+
+    // Draws the meshlets passing the culling tests with the bound vertex
+    // array, merging runs of them into single draws. Returns the number of
+    // triangles drawn.
+    GLuint drawMeshlets(const glm::vec3& cameraPosition,
+      const Frustum& frustum);
 };
 
 #endif
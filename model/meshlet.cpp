@@ -0,0 +1,43 @@
+#include "meshlet.h"
+
+Frustum::Frustum(const glm::mat4& matrix) {
+  // Gribb and Hartmann, each plane is the last row of the matrix plus or minus
+  // one of the other rows.
+  glm::vec4 rows[4];
+  for (GLuint i = 0; i < 4; i++) {
+    rows[i] = glm::vec4(matrix[0][i], matrix[1][i], matrix[2][i],
+        matrix[3][i]);
+  }
+
+  for (GLuint i = 0; i < 3; i++) {
+    planes[i * 2 + 0] = rows[3] + rows[i];
+    planes[i * 2 + 1] = rows[3] - rows[i];
+  }
+
+  // Normalize so plane distances are real distances.
+  for (GLuint i = 0; i < 6; i++) {
+    planes[i] /= glm::length(glm::vec3(planes[i]));
+  }
+}
+
+bool Frustum::intersects(const glm::vec3& center, GLfloat radius) const {
+  for (GLuint i = 0; i < 6; i++) {
+    if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool cullMeshlet(const Meshlet& meshlet, const glm::vec3& cameraPosition,
+    const Frustum& frustum) {
+  if (!frustum.intersects(meshlet.center, meshlet.radius)) {
+    return true;
+  }
+
+  // The whole cluster faces away when the camera is inside the cone mirrored
+  // behind it, padded by the bounding sphere.
+  glm::vec3 toCenter = meshlet.center - cameraPosition;
+  return glm::dot(toCenter, meshlet.coneAxis) >=
+    meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+}
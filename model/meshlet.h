@@ -0,0 +1,42 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <glm/glm.hpp>
+
+extern "C" {
+#include <GL/glew.h>
+}
+
+// A run of consecutive triangles in a mesh's index buffer with the bounds
+// needed to cull it as a whole.
+struct Meshlet {
+  GLuint indexOffset;
+  GLuint indexCount;
+
+  // Bounding sphere.
+  glm::vec3 center;
+  GLfloat radius;
+
+  // Every triangle normal lies within the cone around axis. cutoff is the sine
+  // of the cone's half angle, 1 when the cone is too wide to ever be culled.
+  glm::vec3 coneAxis;
+  GLfloat coneCutoff;
+};
+
+// The six planes of a view frustum, pointing inwards.
+struct Frustum {
+  glm::vec4 planes[6];
+
+  // Extracts the planes in the space the matrix transforms from, so passing
+  // projection * view * model gives model space planes.
+  explicit Frustum(const glm::mat4& matrix);
+
+  bool intersects(const glm::vec3& center, GLfloat radius) const;
+};
+
+// Whether the meshlet is outside the frustum or only has triangles facing
+// away from the camera. Both have to be in the same space.
+bool cullMeshlet(const Meshlet& meshlet, const glm::vec3& cameraPosition,
+    const Frustum& frustum);
+
+#endif
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
@@ -7,17 +9,228 @@ extern "C" {
 }
 
 #include "model.h"
+#include "optimize.h"
+#include "threadpool.h"
 
-Model::Model(std::string path) {
-  loadModel(path);
+// Textures are larger than meshes, so only upload a few of them per frame to
+// keep the frame time steady while they stream in.
+const GLuint kTextureUploadsPerUpdate = 1;
+
+// Deduplicate and reorder the imported geometry for the vertex cache, overdraw
+// and vertex fetch before handing it over.
+const bool kOptimizeMeshes = true;
+
+// Store vertices in the 16 byte PackedVertex format instead of 32 bytes of
+// floats. Requires a vertex shader that applies the dequantization uniforms.
+const bool kQuantizeVertices = true;
+
+// Neutral grey sampled until the real textures arrive, and the diffuse color
+// of materials that only have a specular map.
+const GLubyte kPlaceholderGrey = 128;
+
+Model::Model(std::string path, bool async, CpuGeometry cpuGeometry,
+    bool positionStream) :
+  drawnTriangles(0), totalTriangles(0), cpuGeometry(cpuGeometry),
+  positionStream(positionStream), textureBytes(0), importedGeometryBytes(0),
+  vertexMemoryReported(false), meshesQueued(false), finished(false),
+  cancelled(false) {
+  // Save the directory of the model for loading textures relative to it.
+  directory = path.substr(0, path.find_last_of('/'));
+
+  // Create a neutral grey texture to be sampled until the real ones arrive.
+  // Material textures are array layers, so the placeholder is a one layer
+  // array too.
+  const GLubyte grey[] = {
+    kPlaceholderGrey, kPlaceholderGrey, kPlaceholderGrey, 0
+  };
+  placeholderTexture = GLTexture::create();
+  placeholderTexture.setBytes(sizeof(grey));
+  glBindTexture(GL_TEXTURE_2D_ARRAY, placeholderTexture);
+  glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, 1, 1, 1, 0, GL_RGBA,
+      GL_UNSIGNED_BYTE, grey);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+  if (async) {
+    worker = std::thread(&Model::loadModel, this, path);
+  } else {
+    loadModel(path);
+    while (!loaded()) {
+      update();
+    }
+  }
+}
+
+Model::~Model() {
+  // Stop the worker at the next mesh or texture if it's still going.
+  cancelled = true;
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+void Model::update() {
+  // Upload every mesh that is ready. Textures that already made it to the GPU
+  // are used right away, the rest are patched in as they arrive.
+  MeshData data;
+  while (pendingMeshes.pop(data)) {
+    for (GLuint i = 0; i < data.textures.size(); i++) {
+      data.textures[i].id = placeholderTexture;
+      data.textures[i].layer = 0;
+      for (GLuint j = 0; j < loaded_textures.size(); j++) {
+        if (loaded_textures[j].path == data.textures[i].path) {
+          data.textures[i].id = loaded_textures[j].id;
+          data.textures[i].layer = loaded_textures[j].layer;
+          break;
+        }
+      }
+    }
+
+    if (!data.packedVertices.empty()) {
+      meshes.push_back(Mesh(std::move(data.packedVertices), data.quantization,
+            std::move(data.indices), std::move(data.textures)));
+    } else {
+      meshes.push_back(Mesh(std::move(data.vertices), std::move(data.indices),
+            std::move(data.textures)));
+    }
+
+    meshes.back().meshlets = std::move(data.meshlets);
+
+    if (positionStream) {
+      meshes.back().createPositionStream();
+    }
+    if (cpuGeometry != CpuGeometry::Keep) {
+      meshes.back().releaseGeometry(cpuGeometry == CpuGeometry::Positions);
+    }
+  }
+
+  // The worker pushes every mesh before flagging them as queued, so an empty
+  // queue after that means the last one was just uploaded.
+  if (kQuantizeVertices && !vertexMemoryReported && meshesQueued &&
+      pendingMeshes.empty()) {
+    reportVertexMemory();
+    vertexMemoryReported = true;
+  }
+
+  TextureData texture;
+  for (GLuint i = 0; i < kTextureUploadsPerUpdate &&
+      pendingTextures.pop(texture); i++) {
+    if (texture.array >= textureArrays.size()) {
+      textureArrays.resize(texture.array + 1);
+    }
+
+    // Allocate the whole array when its first layer shows up.
+    TextureArray& array = textureArrays[texture.array];
+    if (array.texture == 0) {
+      array.texture = GLTexture::create();
+      array.remaining = texture.layers;
+      glBindTexture(GL_TEXTURE_2D_ARRAY, array.texture);
+      glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, texture.width,
+          texture.height, texture.layers, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+          nullptr);
+    }
+
+    uploadTextureLayer(array.texture, texture);
+    textureBytes += texture.pixels.size() * 4 / 3;
+    array.bytes += texture.pixels.size() * 4 / 3;
+    array.texture.setBytes(array.bytes);
+
+    Texture loaded;
+    loaded.id = array.texture;
+    loaded.layer = texture.layer;
+    loaded.path = texture.path;
+    array.layers.push_back(loaded);
+
+    // Mipmaps are built for every layer at once, so the array is only handed
+    // to the meshes once it's complete.
+    if (--array.remaining > 0) {
+      continue;
+    }
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, array.texture);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    // Swap out the placeholder in every mesh using one of the layers.
+    for (GLuint l = 0; l < array.layers.size(); l++) {
+      const Texture& layer = array.layers[l];
+      loaded_textures.push_back(layer);
+
+      for (GLuint j = 0; j < meshes.size(); j++) {
+        for (GLuint k = 0; k < meshes[j].textures.size(); k++) {
+          if (meshes[j].textures[k].path == layer.path) {
+            meshes[j].textures[k].id = layer.id;
+            meshes[j].textures[k].layer = layer.layer;
+          }
+        }
+      }
+    }
+  }
+}
+
+bool Model::loaded() {
+  // The worker pushes everything before flagging itself as finished, so empty
+  // queues after that mean everything was uploaded.
+  return finished && pendingMeshes.empty() && pendingTextures.empty();
 }
 
-void Model::draw(Shader shader) {
+void Model::draw(const Shader& shader) {
+  MaterialBinding binding(placeholderTexture);
   for (GLuint i = 0; i < meshes.size(); i++) {
-    meshes[i].draw(shader);
+    meshes[i].draw(shader, binding);
   }
 }
 
+void Model::draw(const Shader& shader, const PerspectiveCamera& camera,
+    const glm::mat4& transform) {
+  // Cull in model space so the meshlet bounds don't have to be transformed.
+  glm::vec3 cameraPosition = glm::vec3(glm::inverse(transform) *
+      glm::vec4(camera.position, 1.0f));
+  Frustum frustum(camera.projection * camera.view * transform);
+
+  // Meshes sharing texture arrays only bind them once.
+  MaterialBinding binding(placeholderTexture);
+
+  drawnTriangles = 0;
+  totalTriangles = 0;
+  for (GLuint i = 0; i < meshes.size(); i++) {
+    drawnTriangles += meshes[i].draw(shader, cameraPosition, frustum, binding);
+    totalTriangles += meshes[i].triangleCount();
+  }
+}
+
+void Model::drawDepth(const Shader& shader) {
+  for (GLuint i = 0; i < meshes.size(); i++) {
+    meshes[i].drawDepth(shader);
+  }
+}
+
+void Model::drawDepth(const Shader& shader, const PerspectiveCamera& camera,
+    const glm::mat4& transform) {
+  glm::vec3 cameraPosition = glm::vec3(glm::inverse(transform) *
+      glm::vec4(camera.position, 1.0f));
+  Frustum frustum(camera.projection * camera.view * transform);
+
+  for (GLuint i = 0; i < meshes.size(); i++) {
+    meshes[i].drawDepth(shader, cameraPosition, frustum);
+  }
+}
+
+void Model::reportMemory(std::ostream& out) {
+  size_t cpuBytes = 0;
+  size_t gpuBytes = textureBytes;
+  for (GLuint i = 0; i < meshes.size(); i++) {
+    cpuBytes += meshes[i].cpuBytes();
+    gpuBytes += meshes[i].gpuBytes();
+  }
+
+  out << "Model " << directory << ": " << meshes.size() << " meshes, " <<
+    cpuBytes / 1024 << " KiB in system memory, " << gpuBytes / 1024 <<
+    " KiB on the GPU (" << textureBytes / 1024 << " KiB textures)" <<
+    std::endl;
+}
+
 void Model::loadModel(std::string path) {
   Assimp::Importer importer;
   const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate |
@@ -27,137 +240,439 @@ void Model::loadModel(std::string path) {
   if (!scene || scene->mFlags == AI_SCENE_FLAGS_INCOMPLETE ||
       !scene->mRootNode) {
     std::cerr << "ERROR: " << importer.GetErrorString() << std::endl;
-    delete scene;
+    finished = true;
     return;
   }
 
-  // Save the directory of the model and go to the next stage in the pipeline.
-  directory = path.substr(0, path.find_last_of('/'));
-  processNode(scene->mRootNode, scene);
+  // Flatten the node hierarchy so the meshes can be converted independently
+  // of each other on the shared pool.
+  std::vector<aiMesh*> sceneMeshes;
+  processNode(scene->mRootNode, scene, sceneMeshes);
+
+  // Each scene mesh may come out as several parts when it has too many
+  // vertices for 16-bit indices.
+  std::vector<std::vector<MeshData>> converted(sceneMeshes.size());
+  std::vector<VertexCacheStats> before(sceneMeshes.size());
+  std::vector<VertexCacheStats> after(sceneMeshes.size());
+  std::vector<size_t> importedBytes(sceneMeshes.size(), 0);
+  std::vector<std::future<void>> conversions;
+  conversions.reserve(sceneMeshes.size());
+  for (GLuint i = 0; i < sceneMeshes.size(); i++) {
+    conversions.push_back(ThreadPool::shared().submit([this, i, &sceneMeshes,
+        &converted, &before, &after, &importedBytes]() {
+      if (cancelled) {
+        return;
+      }
+
+      MeshData data;
+      processMesh(sceneMeshes[i], data);
+      optimizeMesh(data, before[i], after[i]);
+      importedBytes[i] = data.vertices.size() * sizeof(Vertex) +
+        data.indices.size() * sizeof(GLuint);
+      converted[i] = splitMesh(data);
+
+      for (GLuint j = 0; j < converted[i].size(); j++) {
+        MeshData& part = converted[i][j];
+        part.meshlets = buildMeshlets(part.vertices, part.indices);
+      }
+
+      if (kQuantizeVertices) {
+        for (GLuint j = 0; j < converted[i].size(); j++) {
+          MeshData& part = converted[i][j];
+          part.quantization = quantizeVertices(part.vertices,
+              part.packedVertices);
+          std::vector<Vertex>().swap(part.vertices);
+        }
+      }
+    }));
+  }
+
+  // Hand the meshes over in scene order as they finish. The queue only allows
+  // one producer, so this thread pushes on behalf of the pool. Every task has
+  // to be waited on even when cancelled since they reference our locals.
+  for (GLuint i = 0; i < conversions.size(); i++) {
+    conversions[i].wait();
+    if (cancelled) {
+      continue;
+    }
+
+    aiMaterial* material = scene->mMaterials[sceneMeshes[i]->mMaterialIndex];
+    std::vector<Texture> textures = processMaterial(material);
+
+    importedGeometryBytes += importedBytes[i];
+    for (GLuint j = 0; j < converted[i].size(); j++) {
+      MeshData& part = converted[i][j];
+      part.textures = textures;
+      pendingMeshes.push(std::move(part));
+    }
+  }
+
+  if (kOptimizeMeshes && !cancelled) {
+    reportVertexCache(path, before, after);
+  }
+  meshesQueued = true;
+
+  // Go to the next stage in the pipeline. Geometry goes first so the model
+  // shows up as soon as possible, textures are streamed in afterwards.
+  if (!cancelled) {
+    decodeTextures();
+  }
+
+  finished = true;
 }
 
-void Model::processNode(aiNode* node, const aiScene* scene) {
-  // Find all meshes in the node and process them.
+void Model::processNode(aiNode* node, const aiScene* scene,
+    std::vector<aiMesh*>& sceneMeshes) {
+  // Find all meshes in the node.
   for (GLuint i = 0; i < node->mNumMeshes; i++) {
-    aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-    meshes.push_back(processMesh(mesh, scene));
+    sceneMeshes.push_back(scene->mMeshes[node->mMeshes[i]]);
   }
 
   // Process all children nodes of this node.
   for (GLuint i = 0; i < node->mNumChildren; i++) {
-    processNode(node->mChildren[i], scene);
+    processNode(node->mChildren[i], scene, sceneMeshes);
   }
 }
 
-Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene) {
-  std::vector<Vertex> vertices;
-  std::vector<GLuint> indices;
-  std::vector<Texture> textures;
+void Model::processMesh(aiMesh* mesh, MeshData& data) {
+  // Assimp stores attributes as tightly packed floats, same as glm, so they can
+  // be copied straight into the preallocated vertices.
+  static_assert(sizeof(aiVector3D) == sizeof(glm::vec3),
+      "aiVector3D and glm::vec3 must have the same layout");
+
+  data.vertices.resize(mesh->mNumVertices);
+  Vertex* vertices = data.vertices.data();
 
   for (GLuint i = 0; i < mesh->mNumVertices; i++) {
-    // Copy the vertex positions and normals into our vertex data structure.
-    // This is probably really inefficient.
-    Vertex vertex;
-    vertex.position = glm::vec3(
-      mesh->mVertices[i].x,
-      mesh->mVertices[i].y,
-      mesh->mVertices[i].z
-    );
-    vertex.normal = glm::vec3(
-      mesh->mNormals[i].x,
-      mesh->mNormals[i].y,
-      mesh->mNormals[i].z
-    );
-
-    // Copy only the first texture coordinate pair. Apparently you can have up
-    // to 8 pairs of texture coordinates (maps?).
-    if (mesh->mTextureCoords[0]) {
-      vertex.uv = glm::vec2(
-        mesh->mTextureCoords[0][i].x,
-        mesh->mTextureCoords[0][i].y
-      );
-    } else {
-      vertex.uv = glm::vec2(0.0f, 0.0f);
+    std::memcpy(&vertices[i].position.x, &mesh->mVertices[i].x,
+        sizeof(glm::vec3));
+  }
+
+  if (mesh->mNormals) {
+    for (GLuint i = 0; i < mesh->mNumVertices; i++) {
+      std::memcpy(&vertices[i].normal.x, &mesh->mNormals[i].x,
+          sizeof(glm::vec3));
+    }
+  } else {
+    for (GLuint i = 0; i < mesh->mNumVertices; i++) {
+      vertices[i].normal = glm::vec3(0.0f, 0.0f, 0.0f);
     }
+  }
 
-    // Push the vertex onto the mesh.
-    vertices.push_back(vertex);
+  // Copy only the first texture coordinate pair. Apparently you can have up
+  // to 8 pairs of texture coordinates (maps?).
+  const aiVector3D* uvs = mesh->mTextureCoords[0];
+  if (uvs) {
+    for (GLuint i = 0; i < mesh->mNumVertices; i++) {
+      vertices[i].uv = glm::vec2(uvs[i].x, uvs[i].y);
+    }
+  } else {
+    for (GLuint i = 0; i < mesh->mNumVertices; i++) {
+      vertices[i].uv = glm::vec2(0.0f, 0.0f);
+    }
   }
 
-  // Add all the indices in all of the mesh's faces.
+  // Add all the indices in all of the mesh's faces. Faces are triangulated on
+  // import, but points and lines can still show up. Everything after this is
+  // drawn and split as triangles, so only triangles are kept.
+  GLuint indexCount = 0;
   for (GLuint i = 0; i < mesh->mNumFaces; i++) {
-    aiFace face = mesh->mFaces[i];
+    if (mesh->mFaces[i].mNumIndices == 3) {
+      indexCount += 3;
+    }
+  }
+
+  data.indices.resize(indexCount);
+  GLuint* indices = data.indices.data();
+
+  for (GLuint i = 0; i < mesh->mNumFaces; i++) {
+    const aiFace& face = mesh->mFaces[i];
+    if (face.mNumIndices != 3) {
+      continue;
+    }
+    std::memcpy(indices, face.mIndices, 3 * sizeof(GLuint));
+    indices += 3;
+  }
+}
+
+std::vector<Model::MeshData> Model::splitMesh(MeshData& data) {
+  std::vector<MeshData> parts;
+  if (data.vertices.size() <= kMaxShortIndexVertices) {
+    parts.push_back(std::move(data));
+    return parts;
+  }
+
+  // Walk the triangles in their optimized order and start a new part whenever
+  // the next triangle would push the current one over the vertex limit. Each
+  // part gets its own compacted copy of the vertices it uses.
+  const GLuint kUnused = ~0u;
+  std::vector<GLuint> remap(data.vertices.size(), kUnused);
+  std::vector<GLuint> used;
+
+  for (GLuint i = 0; i + 2 < data.indices.size(); i += 3) {
+    GLuint added = 0;
+    for (GLuint j = 0; j < 3; j++) {
+      added += remap[data.indices[i + j]] == kUnused;
+    }
 
-    // Add the indices for the current face.
-    for (GLuint j = 0; j < face.mNumIndices; j++) {
-      indices.push_back(face.mIndices[j]);
+    if (parts.empty() ||
+        parts.back().vertices.size() + added > kMaxShortIndexVertices) {
+      for (GLuint j = 0; j < used.size(); j++) {
+        remap[used[j]] = kUnused;
+      }
+      used.clear();
+      parts.push_back(MeshData());
+    }
+
+    MeshData& part = parts.back();
+    for (GLuint j = 0; j < 3; j++) {
+      GLuint index = data.indices[i + j];
+      if (remap[index] == kUnused) {
+        remap[index] = part.vertices.size();
+        part.vertices.push_back(data.vertices[index]);
+        used.push_back(index);
+      }
+      part.indices.push_back(remap[index]);
     }
   }
 
-  // Get the material diffuse and specular values.
-  aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-  std::vector<Texture> diffuseMaps = loadMaterialTextures(material,
-      aiTextureType_DIFFUSE, "texture_diffuse");
-  textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-  std::vector<Texture> specularMaps = loadMaterialTextures(material,
-      aiTextureType_SPECULAR, "texture_specular");
-  textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+  return parts;
+}
 
-  return Mesh(vertices, indices, textures);
+void Model::optimizeMesh(MeshData& data, VertexCacheStats& before,
+    VertexCacheStats& after) {
+  before = analyzeVertexCache(data.indices, data.vertices.size());
+  if (!kOptimizeMeshes) {
+    after = before;
+    return;
+  }
+
+  // Assimp hands out a separate vertex per face corner for most formats, so
+  // merge them first or there is nothing for the cache to reuse.
+  deduplicateVertices(data.vertices, data.indices);
+  optimizeTriangleOrder(data.vertices, data.indices);
+  optimizeVertexFetch(data.vertices, data.indices);
+
+  after = analyzeVertexCache(data.indices, data.vertices.size());
 }
 
-std::vector<Texture> Model::loadMaterialTextures(aiMaterial* material,
-    aiTextureType type, std::string typeName) {
+void Model::reportVertexMemory() {
+  // Sizes of the buffers as uploaded, so the padding of the packed vertices
+  // and the vertices duplicated by splitting are counted too.
+  size_t vertexBytes = 0;
+  size_t indexBytes = 0;
+  for (GLuint i = 0; i < meshes.size(); i++) {
+    vertexBytes += meshes[i].vertexBytes();
+    indexBytes += meshes[i].indexBytes();
+  }
+
+  std::cout << "Model " << directory << ": geometry " <<
+    importedGeometryBytes / 1024 << " KiB as floats -> " <<
+    (vertexBytes + indexBytes) / 1024 << " KiB uploaded (" <<
+    vertexBytes / 1024 << " KiB vertices, " << indexBytes / 1024 <<
+    " KiB indices)" << std::endl;
+}
+
+void Model::reportVertexCache(const std::string& path,
+    const std::vector<VertexCacheStats>& before,
+    const std::vector<VertexCacheStats>& after) {
+  VertexCacheStats total[2] = {};
+  for (GLuint i = 0; i < before.size(); i++) {
+    const VertexCacheStats* stats[2] = { &before[i], &after[i] };
+    for (GLuint j = 0; j < 2; j++) {
+      total[j].triangles += stats[j]->triangles;
+      total[j].vertices += stats[j]->vertices;
+      total[j].transforms += stats[j]->transforms;
+    }
+  }
+
+  std::cout << path << ": " << total[0].vertices << " -> " <<
+    total[1].vertices << " vertices, ACMR " << total[0].acmr() << " -> " <<
+    total[1].acmr() << ", ATVR " << total[0].atvr() << " -> " <<
+    total[1].atvr() << " (" << kVertexCacheSize << " entry FIFO)" << std::endl;
+}
+
+std::vector<Texture> Model::processMaterial(aiMaterial* material) {
   std::vector<Texture> textures;
 
-  for(GLuint i = 0; i < material->GetTextureCount(type); i++) {
-    aiString str;
-    material->GetTexture(type, i, &str);
+  // Only the first diffuse and specular maps are used, they get packed into
+  // one texture so the shader only samples once. Either may be missing.
+  MaterialMaps maps;
+  if (material->GetTextureCount(aiTextureType_DIFFUSE) == 0 &&
+      material->GetTextureCount(aiTextureType_SPECULAR) == 0) {
+    return textures;
+  }
+  if (material->GetTextureCount(aiTextureType_DIFFUSE) > 0) {
+    material->GetTexture(aiTextureType_DIFFUSE, 0, &maps.diffuse);
+  }
+  if (material->GetTextureCount(aiTextureType_SPECULAR) > 0) {
+    material->GetTexture(aiTextureType_SPECULAR, 0, &maps.specular);
+  }
+
+  maps.key = maps.diffuse;
+  maps.key.Append("|");
+  maps.key.Append(maps.specular.C_Str());
+
+  // Only reference the texture here, it gets decoded once all the meshes
+  // have been handed over.
+  Texture texture;
+  texture.id = 0;
+  texture.layer = 0;
+  texture.type = "texture_diffuse";
+  texture.path = maps.key;
+  textures.push_back(texture);
+
+  GLboolean skip = false;
+  for (GLuint i = 0; i < materialMaps.size(); i++) {
+    if (materialMaps[i].key == maps.key) {
+      skip = true;
+      break;
+    }
+  }
+
+  if (!skip) {
+    materialMaps.push_back(maps);
+  }
+
+  return textures;
+}
 
-    GLboolean skip = false;
-    for (GLuint j = 0; j < loaded_textures.size(); j++) {
-      if (loaded_textures[j].path == str) {
-        textures.push_back(loaded_textures[j]);
-        skip = true;
-        break;
+void Model::decodeTextures() {
+  // Decode every image on the pool.
+  std::vector<TextureData> decoded(materialMaps.size());
+  std::vector<std::future<void>> decodes;
+  decodes.reserve(materialMaps.size());
+  for (GLuint i = 0; i < materialMaps.size(); i++) {
+    decodes.push_back(ThreadPool::shared().submit([this, i, &decoded]() {
+      if (!cancelled) {
+        decodeTexture(materialMaps[i], decoded[i]);
       }
+    }));
+  }
+
+  for (GLuint i = 0; i < decodes.size(); i++) {
+    decodes[i].wait();
+  }
+  if (cancelled) {
+    return;
+  }
+
+  // Textures of the same size become layers of one array, so meshes with
+  // different materials don't need different textures bound.
+  std::vector<std::pair<GLint, GLint>> sizes;
+  std::vector<GLuint> layerCounts;
+  for (GLuint i = 0; i < decoded.size(); i++) {
+    TextureData& texture = decoded[i];
+    if (texture.pixels.empty()) {
+      continue;
     }
 
-    if (!skip) {
-      Texture texture;
-      texture.id = loadTexture(str.C_Str(), directory);
-      texture.type = typeName;
-      texture.path = str;
-      textures.push_back(texture);
-      loaded_textures.push_back(texture);
+    std::pair<GLint, GLint> size(texture.width, texture.height);
+    texture.array = std::find(sizes.begin(), sizes.end(), size) -
+      sizes.begin();
+    if (texture.array == sizes.size()) {
+      sizes.push_back(size);
+      layerCounts.push_back(0);
     }
+    texture.layer = layerCounts[texture.array]++;
   }
 
-  return textures;
+  for (GLuint i = 0; i < decoded.size(); i++) {
+    if (!decoded[i].pixels.empty()) {
+      decoded[i].layers = layerCounts[decoded[i].array];
+      pendingTextures.push(std::move(decoded[i]));
+    }
+  }
 }
 
-GLint Model::loadTexture(const char* path, std::string directory) {
-  // Generate texture ID and load texture data.
-  std::string filename(path);
-  filename = directory + '/' + filename;
-  GLuint textureID;
-  glGenTextures(1, &textureID);
-  int width, height;
-  unsigned char* image = SOIL_load_image(filename.c_str(), &width, &height, 0, SOIL_LOAD_RGB);
+void Model::decodeTexture(const MaterialMaps& maps, TextureData& texture) {
+  // Load the texture data relative to the model.
+  std::string diffuseFilename = directory + '/' + maps.diffuse.C_Str();
+  std::string specularFilename = directory + '/' + maps.specular.C_Str();
 
-  // Assign texture to ID.
-  glBindTexture(GL_TEXTURE_2D, textureID);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-  glGenerateMipmap(GL_TEXTURE_2D);
+  texture.path = maps.key;
+  unsigned char* diffuse = nullptr;
+  if (maps.diffuse.length > 0) {
+    diffuse = SOIL_load_image(diffuseFilename.c_str(), &texture.width,
+        &texture.height, 0, SOIL_LOAD_RGB);
+    if (diffuse == nullptr) {
+      std::cerr << "ERROR: Unable to load texture " << diffuseFilename <<
+        std::endl;
+      return;
+    }
+  }
 
-  // Parameters.
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  int specularWidth = 0;
+  int specularHeight = 0;
+  unsigned char* specular = nullptr;
+  if (maps.specular.length > 0) {
+    specular = SOIL_load_image(specularFilename.c_str(), &specularWidth,
+        &specularHeight, 0, SOIL_LOAD_RGB);
+    if (specular == nullptr) {
+      std::cerr << "ERROR: Unable to load texture " << specularFilename <<
+        std::endl;
+    }
+  }
+
+  // Without a diffuse map the specular map alone sets the size, and the
+  // material is the placeholder grey with its highlights.
+  if (diffuse == nullptr) {
+    if (specular == nullptr) {
+      return;
+    }
+    texture.width = specularWidth;
+    texture.height = specularHeight;
+  }
+
+  // Diffuse goes into rgb and the specular luminance into alpha. A specular
+  // map of a different size is sampled with nearest filtering, a missing one
+  // leaves the material without highlights.
+  GLint width = texture.width;
+  GLint height = texture.height;
+  texture.pixels.resize(width * height * 4);
+  for (GLint y = 0; y < height; y++) {
+    for (GLint x = 0; x < width; x++) {
+      unsigned char* texel = &texture.pixels[(y * width + x) * 4];
+      texel[0] = texel[1] = texel[2] = kPlaceholderGrey;
+      texel[3] = 0;
+
+      if (diffuse != nullptr) {
+        const unsigned char* color = &diffuse[(y * width + x) * 3];
+        texel[0] = color[0];
+        texel[1] = color[1];
+        texel[2] = color[2];
+      }
 
-  glBindTexture(GL_TEXTURE_2D, 0);
-  SOIL_free_image_data(image);
+      if (specular != nullptr) {
+        const unsigned char* intensity = &specular[
+          ((y * specularHeight / height) * specularWidth +
+           x * specularWidth / width) * 3];
+        texel[3] = (intensity[0] * 54 + intensity[1] * 183 +
+            intensity[2] * 19) >> 8;
+      }
+    }
+  }
+
+  if (diffuse != nullptr) {
+    SOIL_free_image_data(diffuse);
+  }
+  if (specular != nullptr) {
+    SOIL_free_image_data(specular);
+  }
+}
+
+void Model::uploadTextureLayer(GLuint array, const TextureData& texture) {
+  // Copy the image into its layer of the array.
+  glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+  glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, texture.layer, texture.width,
+      texture.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, texture.pixels.data());
+
+  // Parameters.
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+      GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-  return textureID;
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
 }
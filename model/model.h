@@ -1,29 +1,169 @@
+#ifndef MODEL_H
+#define MODEL_H
+
+#include <atomic>
+#include <ostream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <assimp/scene.h>
 
 #include "mesh.h"
+#include "optimize.h"
+#include "perspectivecamera.h"
+#include "queue.h"
 #include "shader.h"
 
+// What each mesh keeps in system memory after its geometry was uploaded.
+enum class CpuGeometry {
+  Keep,      // All vertices and indices.
+  Positions, // Positions and indices, enough for culling and picking.
+  Release    // Only the bounds.
+};
+
 class Model {
   public:
-    Model(std::string path);
+    // Loads the model at the given path. When async is set the constructor
+    // returns right away and the model is imported on a worker thread, meshes
+    // then show up one by one as update is called every frame. With
+    // positionStream the meshes also get a position only copy of their
+    // vertices for drawDepth.
+    Model(std::string path, bool async = false,
+        CpuGeometry cpuGeometry = CpuGeometry::Keep,
+        bool positionStream = false);
+    ~Model();
+
+    // Uploads the meshes, and after them the textures, that the worker thread
+    // finished importing. Must be called on the thread owning the context.
+    void update();
+
+    // Whether every mesh and texture made it to the GPU.
+    bool loaded();
 
     // Draws all the meshes.
-    void draw(Shader shader);
+    void draw(const Shader& shader);
+
+    // Draws the meshlets that are visible from the camera with the model
+    // placed at the given transform. The transform may rotate, translate and
+    // scale uniformly.
+    void draw(const Shader& shader, const PerspectiveCamera& camera,
+        const glm::mat4& transform);
+
+    // Same as draw for depth only passes (shadow maps, depth prepasses),
+    // reading only the positions. The culled version leaves the triangle
+    // counts alone.
+    void drawDepth(const Shader& shader);
+    void drawDepth(const Shader& shader, const PerspectiveCamera& camera,
+        const glm::mat4& transform);
+
+    // Triangles drawn by the last culled draw, and how many the model has.
+    GLuint drawnTriangles;
+    GLuint totalTriangles;
+
+    // Dumps how much geometry and texture data the model holds in system and
+    // GPU memory.
+    void reportMemory(std::ostream& out);
   private:
+    // Mesh data imported on the worker thread and waiting to be uploaded. The
+    // texture ids are filled in on upload.
+    struct MeshData {
+      std::vector<Vertex> vertices;
+      std::vector<GLuint> indices;
+      std::vector<Texture> textures;
+
+      // Filled instead of vertices when the vertices are quantized.
+      std::vector<PackedVertex> packedVertices;
+      VertexQuantization quantization;
+
+      std::vector<Meshlet> meshlets;
+    };
+
+    // Decoded RGBA image waiting to be uploaded into a layer of a texture
+    // array, diffuse in rgb and specular intensity in alpha. layers is the
+    // total layer count of that array.
+    struct TextureData {
+      aiString path;
+      int width;
+      int height;
+      std::vector<unsigned char> pixels;
+      GLuint array;
+      GLuint layer;
+      GLuint layers;
+    };
+
+    // Material textures of one size, packed as layers of a single array
+    // texture. Handed to the meshes once every layer was uploaded.
+    struct TextureArray {
+      GLTexture texture;
+      GLuint remaining;
+      size_t bytes;
+      std::vector<Texture> layers;
+
+      TextureArray() : remaining(0), bytes(0) {}
+    };
+
     // Model data.
     std::vector<Mesh> meshes;
     std::string directory;
 
-    // Texture data to prevent duplicate textures.
+    // Texture data to prevent duplicate textures. The meshes only reference the
+    // arrays by id and layer, the model owns them.
     std::vector<Texture> loaded_textures;
+    std::vector<TextureArray> textureArrays;
+
+    // Bound in place of textures that have not been streamed in yet.
+    GLTexture placeholderTexture;
+
+    // Geometry kept after upload, whether the meshes get a position stream,
+    // and the bytes of all uploaded textures.
+    CpuGeometry cpuGeometry;
+    bool positionStream;
+    size_t textureBytes;
+
+    // Geometry the imported meshes would take as float vertices with 32-bit
+    // indices and without splitting, set by the worker before meshesQueued.
+    // Compared against the uploaded buffers once they are all on the GPU.
+    size_t importedGeometryBytes;
+    bool vertexMemoryReported;
+
+    // Worker thread state. The queues hand data over to the render thread
+    // without either side ever blocking. meshesQueued is set once the last
+    // mesh was pushed.
+    std::thread worker;
+    std::atomic<bool> meshesQueued;
+    std::atomic<bool> finished;
+    std::atomic<bool> cancelled;
+    SPSCQueue<MeshData> pendingMeshes;
+    SPSCQueue<TextureData> pendingTextures;
+
+    // Maps of a material, packed into a single texture on import. key names
+    // the pair and doubles as the path of the packed texture.
+    struct MaterialMaps {
+      aiString key;
+      aiString diffuse;
+      aiString specular;
+    };
+
+    // Unique materials found while importing (worker side, only touched by
+    // the loader thread and not the pool).
+    std::vector<MaterialMaps> materialMaps;
 
     void loadModel(std::string path);
-    void processNode(aiNode* node, const aiScene* scene);
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene);
-    std::vector<Texture> loadMaterialTextures(aiMaterial* material,
-        aiTextureType type, std::string typeName);
-    GLint loadTexture(const char* path, std::string directory);
+    void processNode(aiNode* node, const aiScene* scene,
+        std::vector<aiMesh*>& sceneMeshes);
+    void processMesh(aiMesh* mesh, MeshData& data);
+    std::vector<MeshData> splitMesh(MeshData& data);
+    void optimizeMesh(MeshData& data, VertexCacheStats& before,
+        VertexCacheStats& after);
+    void reportVertexMemory();
+    void reportVertexCache(const std::string& path,
+        const std::vector<VertexCacheStats>& before,
+        const std::vector<VertexCacheStats>& after);
+    std::vector<Texture> processMaterial(aiMaterial* material);
+    void decodeTextures();
+    void decodeTexture(const MaterialMaps& maps, TextureData& texture);
+    void uploadTextureLayer(GLuint array, const TextureData& texture);
 };
+
+#endif
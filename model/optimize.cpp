@@ -0,0 +1,414 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+#include "optimize.h"
+
+GLfloat VertexCacheStats::acmr() const {
+  return triangles > 0 ? (GLfloat)transforms / triangles : 0.0f;
+}
+
+GLfloat VertexCacheStats::atvr() const {
+  return vertices > 0 ? (GLfloat)transforms / vertices : 0.0f;
+}
+
+// Largest angle between a triangle normal and the running cluster normal
+// before a meshlet over the minimum size gets closed.
+const GLfloat kMeshletMaxAngle = glm::radians(45.0f);
+
+VertexCacheStats analyzeVertexCache(const std::vector<GLuint>& indices,
+    GLuint vertexCount, GLuint cacheSize) {
+  VertexCacheStats stats;
+  stats.triangles = indices.size() / 3;
+  stats.vertices = 0;
+  stats.transforms = 0;
+
+  // A vertex is in the cache if it was pushed less than cacheSize misses ago,
+  // which is exactly how a FIFO behaves without having to store one.
+  std::vector<GLuint> pushedAt(vertexCount, 0);
+  std::vector<bool> referenced(vertexCount, false);
+
+  for (GLuint i = 0; i < indices.size(); i++) {
+    GLuint index = indices[i];
+    if (!referenced[index]) {
+      referenced[index] = true;
+      stats.vertices++;
+    }
+
+    if (pushedAt[index] == 0 ||
+        stats.transforms + 1 - pushedAt[index] > cacheSize) {
+      stats.transforms++;
+      pushedAt[index] = stats.transforms;
+    }
+  }
+
+  return stats;
+}
+
+namespace {
+  // Hashes the raw bytes of a vertex (FNV-1a). Vertex is 8 tightly packed
+  // floats so there is no padding to worry about.
+  struct VertexHash {
+    size_t operator()(const Vertex& vertex) const {
+      const unsigned char* bytes = (const unsigned char*)&vertex;
+      size_t hash = 2166136261u;
+      for (size_t i = 0; i < sizeof(Vertex); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+      }
+      return hash;
+    }
+  };
+
+  struct VertexEqual {
+    bool operator()(const Vertex& a, const Vertex& b) const {
+      return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+    }
+  };
+
+  // Triangles using each vertex, stored as one flat list with per vertex
+  // offsets. Indices left over after the last whole triangle are ignored.
+  struct Adjacency {
+    std::vector<GLuint> offsets;
+    std::vector<GLuint> triangles;
+
+    Adjacency(const std::vector<GLuint>& indices, GLuint vertexCount) {
+      GLuint indexCount = indices.size() / 3 * 3;
+      offsets.assign(vertexCount + 1, 0);
+      for (GLuint i = 0; i < indexCount; i++) {
+        offsets[indices[i] + 1]++;
+      }
+      for (GLuint i = 0; i < vertexCount; i++) {
+        offsets[i + 1] += offsets[i];
+      }
+
+      std::vector<GLuint> fill(offsets.begin(), offsets.end() - 1);
+      triangles.resize(indexCount);
+      for (GLuint i = 0; i < indexCount; i++) {
+        triangles[fill[indices[i]]++] = i / 3;
+      }
+    }
+  };
+}
+
+void deduplicateVertices(std::vector<Vertex>& vertices,
+    std::vector<GLuint>& indices) {
+  std::unordered_map<Vertex, GLuint, VertexHash, VertexEqual> unique;
+  unique.reserve(vertices.size());
+
+  std::vector<GLuint> remap(vertices.size());
+  std::vector<Vertex> merged;
+  merged.reserve(vertices.size());
+
+  for (GLuint i = 0; i < vertices.size(); i++) {
+    auto inserted = unique.insert(std::make_pair(vertices[i],
+        (GLuint)merged.size()));
+    if (inserted.second) {
+      merged.push_back(vertices[i]);
+    }
+    remap[i] = inserted.first->second;
+  }
+
+  for (GLuint i = 0; i < indices.size(); i++) {
+    indices[i] = remap[indices[i]];
+  }
+
+  vertices.swap(merged);
+}
+
+void optimizeTriangleOrder(const std::vector<Vertex>& vertices,
+    std::vector<GLuint>& indices, GLuint cacheSize,
+    GLfloat overdrawThreshold) {
+  GLuint vertexCount = vertices.size();
+  GLuint triangleCount = indices.size() / 3;
+  if (triangleCount == 0) {
+    return;
+  }
+
+  // Only whole triangles can be reordered, a stray point or line face would
+  // otherwise be counted as a triangle past the end.
+  indices.resize(triangleCount * 3);
+
+  Adjacency adjacency(indices, vertexCount);
+
+  // Live triangles left per vertex, and the time each vertex was last put in
+  // the cache.
+  std::vector<GLuint> live(vertexCount);
+  for (GLuint i = 0; i < vertexCount; i++) {
+    live[i] = adjacency.offsets[i + 1] - adjacency.offsets[i];
+  }
+  std::vector<GLuint> cachedAt(vertexCount, 0);
+  std::vector<bool> emitted(triangleCount, false);
+
+  std::vector<GLuint> order;
+  order.reserve(triangleCount);
+
+  // Tipsify walks the mesh by fanning around one vertex at a time. When no
+  // vertex touched by the last fan is a good continuation it falls back to the
+  // dead-end stack, and then to a linear scan. Those jumps are where the cache
+  // gets flushed anyway, so they double as the cluster boundaries for sorting.
+  std::vector<GLuint> deadEnd;
+  std::vector<GLuint> candidates;
+  std::vector<GLuint> clusterStarts;
+  GLuint time = cacheSize + 1;
+  GLuint cursor = 0;
+  GLint fan = 0;
+  bool jumped = true;
+
+  while (fan >= 0) {
+    if (jumped) {
+      clusterStarts.push_back(order.size());
+    }
+
+    candidates.clear();
+    GLuint fanEnd = adjacency.offsets[fan + 1];
+    for (GLuint i = adjacency.offsets[fan]; i < fanEnd; i++) {
+      GLuint triangle = adjacency.triangles[i];
+      if (emitted[triangle]) {
+        continue;
+      }
+
+      for (GLuint j = 0; j < 3; j++) {
+        GLuint vertex = indices[triangle * 3 + j];
+        deadEnd.push_back(vertex);
+        candidates.push_back(vertex);
+        live[vertex]--;
+        if (time - cachedAt[vertex] > cacheSize) {
+          cachedAt[vertex] = time++;
+        }
+      }
+
+      emitted[triangle] = true;
+      order.push_back(triangle);
+    }
+
+    // Pick the candidate that will still be in the cache once its remaining
+    // triangles are emitted, preferring the oldest one.
+    GLint next = -1;
+    GLint best = -1;
+    for (GLuint i = 0; i < candidates.size(); i++) {
+      GLuint vertex = candidates[i];
+      if (live[vertex] == 0) {
+        continue;
+      }
+
+      GLint priority = 0;
+      if (time - cachedAt[vertex] + 2 * live[vertex] <= cacheSize) {
+        priority = time - cachedAt[vertex];
+      }
+      if (priority > best) {
+        best = priority;
+        next = vertex;
+      }
+    }
+
+    jumped = false;
+    if (next < 0) {
+      while (!deadEnd.empty() && next < 0) {
+        GLuint vertex = deadEnd.back();
+        deadEnd.pop_back();
+        if (live[vertex] > 0) {
+          next = vertex;
+          jumped = true;
+        }
+      }
+
+      while (next < 0 && cursor < vertexCount) {
+        if (live[cursor] > 0) {
+          next = cursor;
+          jumped = true;
+        }
+        cursor++;
+      }
+    }
+
+    fan = next;
+  }
+
+  std::vector<GLuint> tipsified(indices.size());
+  for (GLuint i = 0; i < order.size(); i++) {
+    std::memcpy(&tipsified[i * 3], &indices[order[i] * 3], 3 * sizeof(GLuint));
+  }
+
+  // Sort the clusters so the ones facing away from the center of the mesh are
+  // drawn first, they are the most likely to occlude the rest.
+  glm::vec3 meshCenter(0.0f, 0.0f, 0.0f);
+  for (GLuint i = 0; i < vertexCount; i++) {
+    meshCenter += vertices[i].position;
+  }
+  meshCenter /= (GLfloat)std::max(vertexCount, 1u);
+
+  clusterStarts.push_back(order.size());
+  std::vector<std::pair<GLfloat, GLuint>> clusters;
+  for (GLuint cluster = 0; cluster + 1 < clusterStarts.size(); cluster++) {
+    GLuint first = clusterStarts[cluster];
+    GLuint last = clusterStarts[cluster + 1];
+
+    glm::vec3 center(0.0f, 0.0f, 0.0f);
+    glm::vec3 normal(0.0f, 0.0f, 0.0f);
+    for (GLuint t = first; t < last; t++) {
+      const glm::vec3& a = vertices[tipsified[t * 3 + 0]].position;
+      const glm::vec3& b = vertices[tipsified[t * 3 + 1]].position;
+      const glm::vec3& c = vertices[tipsified[t * 3 + 2]].position;
+
+      // The cross product is weighted by area which is what we want here.
+      center += (a + b + c) / 3.0f;
+      normal += glm::cross(b - a, c - a);
+    }
+    center /= (GLfloat)(last - first);
+
+    clusters.push_back(std::make_pair(glm::dot(center - meshCenter, normal),
+        cluster));
+  }
+
+  std::stable_sort(clusters.begin(), clusters.end(),
+      [](const std::pair<GLfloat, GLuint>& a,
+        const std::pair<GLfloat, GLuint>& b) {
+    return a.first > b.first;
+  });
+
+  std::vector<GLuint> sorted;
+  sorted.reserve(indices.size());
+  for (GLuint i = 0; i < clusters.size(); i++) {
+    GLuint cluster = clusters[i].second;
+    sorted.insert(sorted.end(), tipsified.begin() + clusterStarts[cluster] * 3,
+        tipsified.begin() + clusterStarts[cluster + 1] * 3);
+  }
+
+  GLfloat tipsifiedAcmr = analyzeVertexCache(tipsified, vertexCount,
+      cacheSize).acmr();
+  GLfloat sortedAcmr = analyzeVertexCache(sorted, vertexCount,
+      cacheSize).acmr();
+  if (sortedAcmr <= tipsifiedAcmr * overdrawThreshold) {
+    indices.swap(sorted);
+  } else {
+    indices.swap(tipsified);
+  }
+}
+
+void optimizeVertexFetch(std::vector<Vertex>& vertices,
+    std::vector<GLuint>& indices) {
+  const GLuint kUnused = ~0u;
+  std::vector<GLuint> remap(vertices.size(), kUnused);
+  std::vector<Vertex> reordered;
+  reordered.reserve(vertices.size());
+
+  for (GLuint i = 0; i < indices.size(); i++) {
+    GLuint& index = indices[i];
+    if (remap[index] == kUnused) {
+      remap[index] = reordered.size();
+      reordered.push_back(vertices[index]);
+    }
+    index = remap[index];
+  }
+
+  vertices.swap(reordered);
+}
+
+namespace {
+  // Fills in the bounding sphere and normal cone for the triangles of the
+  // meshlet.
+  void computeBounds(const std::vector<Vertex>& vertices,
+      const std::vector<GLuint>& indices, Meshlet& meshlet) {
+    GLuint first = meshlet.indexOffset;
+    GLuint last = meshlet.indexOffset + meshlet.indexCount;
+
+    // Center the sphere on the bounding box, which is close enough to the
+    // optimal sphere for the handful of vertices in a meshlet.
+    glm::vec3 minPosition = vertices[indices[first]].position;
+    glm::vec3 maxPosition = minPosition;
+    for (GLuint i = first; i < last; i++) {
+      minPosition = glm::min(minPosition, vertices[indices[i]].position);
+      maxPosition = glm::max(maxPosition, vertices[indices[i]].position);
+    }
+
+    meshlet.center = (minPosition + maxPosition) * 0.5f;
+    meshlet.radius = 0.0f;
+    for (GLuint i = first; i < last; i++) {
+      meshlet.radius = std::max(meshlet.radius,
+          glm::length(vertices[indices[i]].position - meshlet.center));
+    }
+
+    // The axis is the average facing direction, the cone has to be wide
+    // enough to hold every triangle.
+    glm::vec3 axis(0.0f);
+    std::vector<glm::vec3> normals;
+    for (GLuint i = first; i < last; i += 3) {
+      const glm::vec3& a = vertices[indices[i + 0]].position;
+      const glm::vec3& b = vertices[indices[i + 1]].position;
+      const glm::vec3& c = vertices[indices[i + 2]].position;
+
+      glm::vec3 normal = glm::cross(b - a, c - a);
+      GLfloat area = glm::length(normal);
+      if (area > 0.0f) {
+        normals.push_back(normal / area);
+        axis += normals.back();
+      }
+    }
+
+    GLfloat axisLength = glm::length(axis);
+    if (normals.empty() || axisLength == 0.0f) {
+      meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+      meshlet.coneCutoff = 1.0f;
+      return;
+    }
+    meshlet.coneAxis = axis / axisLength;
+
+    GLfloat minDot = 1.0f;
+    for (GLuint i = 0; i < normals.size(); i++) {
+      minDot = std::min(minDot, glm::dot(normals[i], meshlet.coneAxis));
+    }
+
+    // A cone of 90 degrees or more always has a triangle facing the camera.
+    meshlet.coneCutoff = minDot <= 0.0f ? 1.0f :
+      std::sqrt(1.0f - minDot * minDot);
+  }
+}
+
+std::vector<Meshlet> buildMeshlets(const std::vector<Vertex>& vertices,
+    const std::vector<GLuint>& indices) {
+  std::vector<Meshlet> meshlets;
+  GLfloat minDot = std::cos(kMeshletMaxAngle);
+
+  Meshlet meshlet;
+  meshlet.indexOffset = 0;
+  meshlet.indexCount = 0;
+  glm::vec3 clusterNormal(0.0f);
+
+  for (GLuint i = 0; i + 2 < indices.size(); i += 3) {
+    const glm::vec3& a = vertices[indices[i + 0]].position;
+    const glm::vec3& b = vertices[indices[i + 1]].position;
+    const glm::vec3& c = vertices[indices[i + 2]].position;
+    glm::vec3 normal = glm::cross(b - a, c - a);
+    GLfloat area = glm::length(normal);
+    if (area > 0.0f) {
+      normal /= area;
+    }
+
+    // Close the meshlet when it's full, or when it's big enough and this
+    // triangle would widen its cone too much.
+    GLuint triangles = meshlet.indexCount / 3;
+    GLfloat clusterLength = glm::length(clusterNormal);
+    bool diverges = clusterLength > 0.0f && area > 0.0f &&
+      glm::dot(normal, clusterNormal / clusterLength) < minDot;
+    if (triangles >= kMeshletMaxTriangles ||
+        (triangles >= kMeshletMinTriangles && diverges)) {
+      computeBounds(vertices, indices, meshlet);
+      meshlets.push_back(meshlet);
+
+      meshlet.indexOffset = i;
+      meshlet.indexCount = 0;
+      clusterNormal = glm::vec3(0.0f);
+    }
+
+    meshlet.indexCount += 3;
+    clusterNormal += normal;
+  }
+
+  if (meshlet.indexCount > 0) {
+    computeBounds(vertices, indices, meshlet);
+    meshlets.push_back(meshlet);
+  }
+
+  return meshlets;
+}
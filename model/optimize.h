@@ -0,0 +1,63 @@
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+
+#include <vector>
+
+extern "C" {
+#include <GL/glew.h>
+}
+
+#include "mesh.h"
+#include "meshlet.h"
+
+// Triangle budget of a meshlet. Clusters are closed somewhere between the two
+// once their normals start to diverge, so they stay cullable.
+const GLuint kMeshletMinTriangles = 64;
+const GLuint kMeshletMaxTriangles = 128;
+
+// Size of the simulated post-transform vertex cache. Real hardware varies, but
+// orderings tuned for a 16 entry FIFO hold up well on all of it.
+const GLuint kVertexCacheSize = 16;
+
+// Result of running an index buffer through a simulated FIFO vertex cache.
+struct VertexCacheStats {
+  GLuint triangles;
+  GLuint vertices;
+  GLuint transforms;
+
+  // Average cache miss ratio, vertex shader runs per triangle (0.5 - 3.0).
+  GLfloat acmr() const;
+
+  // Average transform to vertex ratio, vertex shader runs per vertex (1.0 is
+  // perfect).
+  GLfloat atvr() const;
+};
+
+// Simulates a FIFO cache of the given size over the triangle list.
+VertexCacheStats analyzeVertexCache(const std::vector<GLuint>& indices,
+    GLuint vertexCount, GLuint cacheSize = kVertexCacheSize);
+
+// Merges bitwise identical vertices and rewrites the indices to match.
+void deduplicateVertices(std::vector<Vertex>& vertices,
+    std::vector<GLuint>& indices);
+
+// Reorders triangles for post-transform cache hits using Tipsify (Sander et al.
+// 2007), then sorts the resulting clusters so outward facing ones come first to
+// cut overdraw. The cluster order is only kept if the cache miss ratio stays
+// within the given threshold of the cache-only ordering.
+void optimizeTriangleOrder(const std::vector<Vertex>& vertices,
+    std::vector<GLuint>& indices, GLuint cacheSize = kVertexCacheSize,
+    GLfloat overdrawThreshold = 1.05f);
+
+// Reorders vertices in the order the indices first reference them so the
+// vertex fetch walks memory linearly. Unreferenced vertices are dropped.
+void optimizeVertexFetch(std::vector<Vertex>& vertices,
+    std::vector<GLuint>& indices);
+
+// Splits the triangle list into meshlets along its current order, which after
+// optimizeTriangleOrder is already spatially coherent, and computes their
+// bounding spheres and normal cones.
+std::vector<Meshlet> buildMeshlets(const std::vector<Vertex>& vertices,
+    const std::vector<GLuint>& indices);
+
+#endif
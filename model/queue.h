@@ -0,0 +1,70 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <atomic>
+#include <utility>
+
+// Unbounded lock-free queue for exactly one producer thread and one consumer
+// thread. Nodes are linked through atomic pointers so the consumer never has to
+// wait on the producer (or the other way around).
+template <typename T>
+class SPSCQueue {
+  public:
+    SPSCQueue() {
+      // The consumer always points at an already consumed dummy node.
+      head = tail = new Node();
+    }
+
+    ~SPSCQueue() {
+      while (tail != nullptr) {
+        Node* next = tail->next.load(std::memory_order_relaxed);
+        delete tail;
+        tail = next;
+      }
+    }
+
+    SPSCQueue(const SPSCQueue&) = delete;
+    SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+    // Appends a value. Producer thread only.
+    void push(T value) {
+      Node* node = new Node(std::move(value));
+      head->next.store(node, std::memory_order_release);
+      head = node;
+    }
+
+    // Takes the oldest value if there is one. Consumer thread only.
+    bool pop(T& value) {
+      Node* next = tail->next.load(std::memory_order_acquire);
+      if (next == nullptr) {
+        return false;
+      }
+
+      value = std::move(next->value);
+      delete tail;
+      tail = next;
+
+      return true;
+    }
+
+    // Whether there is nothing left to pop. Consumer thread only.
+    bool empty() const {
+      return tail->next.load(std::memory_order_acquire) == nullptr;
+    }
+  private:
+    struct Node {
+      T value;
+      std::atomic<Node*> next;
+
+      Node() : next(nullptr) {}
+      explicit Node(T value) : value(std::move(value)), next(nullptr) {}
+    };
+
+    // Last node pushed, only touched by the producer.
+    Node* head;
+
+    // Last node popped, only touched by the consumer.
+    Node* tail;
+};
+
+#endif
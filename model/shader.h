@@ -7,10 +7,13 @@ extern "C" {
 #include <GL/glew.h>
 }
 
+#include "globject.h"
+
 class Shader {
   public:
-    // Shader program pointer in the OpenGL state machine.
-    GLuint program;
+    // Shader program pointer in the OpenGL state machine. Owned by the shader,
+    // so shaders can be moved but not copied.
+    GLProgram program;
 
     // Shader constructor for creating a shader program with both a vertex
     // shader and a fragment shader.
@@ -21,6 +24,8 @@ class Shader {
     void use();
   private:
     // Reads a shader (or any file for that matter) and puts it into a string.
+    // Lines of the form #include "file" are replaced by the contents of that
+    // file, relative to the directory of the file being read.
     std::string readShader(std::string filepath);
 
     // Used to check if a shader compiled successfully.
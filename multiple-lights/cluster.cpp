@@ -0,0 +1,234 @@
+#include "cluster.h"
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <math.h>
+
+#include "threadpool.h"
+
+namespace {
+
+// Tile of the grid covering the given NDC coordinate along one axis.
+GLint tile(GLfloat ndc, GLuint count) {
+  GLint index = (GLint)floorf((ndc * 0.5f + 0.5f) * count);
+  return std::min(std::max(index, 0), (GLint)count - 1);
+}
+
+// Replaces the contents of a buffer. Texture buffers can't be empty, so at
+// least one element worth of storage is always allocated.
+void upload(GLuint buffer, const void* data, size_t bytes, size_t minBytes) {
+  glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+  glBufferData(GL_TEXTURE_BUFFER, std::max(bytes, minBytes), nullptr,
+      GL_STREAM_DRAW);
+  if (bytes > 0) {
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+  }
+}
+
+}
+
+LightClusters::LightClusters() : indexCount(0), maxClusterLights(0),
+    binMilliseconds(0.0), grid(kClusterCount * 2, 0),
+    clusterLights(kClusterCount), lightCount(0), clustered(false),
+    listed(false), near(0.1f), far(100.0f) {
+  glGenBuffers(3, this->buffers);
+  glGenTextures(3, this->textures);
+
+  // Lights take four RGBA texels, the grid an offset and count per froxel.
+  const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+  const size_t sizes[3] = { sizeof(PointLight), 2 * sizeof(GLuint),
+    sizeof(GLuint) };
+  for (GLuint i = 0; i < 3; i++) {
+    upload(this->buffers[i], nullptr, 0, sizes[i]);
+    glBindTexture(GL_TEXTURE_BUFFER, this->textures[i]);
+    glTexBuffer(GL_TEXTURE_BUFFER, formats[i], this->buffers[i]);
+  }
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+LightClusters::~LightClusters() {
+  glDeleteTextures(3, this->textures);
+  glDeleteBuffers(3, this->buffers);
+}
+
+void LightClusters::update(const std::vector<PointLight>& lights,
+    const PerspectiveCamera& camera, bool clustered) {
+  this->lightCount = lights.size();
+  this->clustered = clustered;
+  this->listed = false;
+  this->near = camera.near;
+  this->far = camera.far;
+
+  upload(this->buffers[0], lights.data(), lights.size() * sizeof(PointLight),
+      sizeof(PointLight));
+
+  if (clustered) {
+    bin(lights, camera);
+    upload(this->buffers[1], this->grid.data(),
+        this->grid.size() * sizeof(GLuint), 2 * sizeof(GLuint));
+    upload(this->buffers[2], this->indices.data(),
+        this->indices.size() * sizeof(GLuint), sizeof(GLuint));
+  }
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void LightClusters::listObjects(const std::vector<PointLight>& lights,
+    const std::vector<glm::vec4>& objects) {
+  auto start = std::chrono::steady_clock::now();
+
+  // A light reaches an object when their spheres overlap. All lists share
+  // the index buffer, each object keeps its own range of it.
+  this->indices.clear();
+  this->objectRanges.resize(objects.size() * 2);
+  this->maxClusterLights = 0;
+  for (size_t i = 0; i < objects.size(); i++) {
+    glm::vec3 center(objects[i].x, objects[i].y, objects[i].z);
+    GLuint offset = this->indices.size();
+    for (GLuint j = 0; j < lights.size(); j++) {
+      GLfloat reach = lights[j].radius + objects[i].w;
+      glm::vec3 offsetToLight = lights[j].position - center;
+      if (glm::dot(offsetToLight, offsetToLight) < reach * reach) {
+        this->indices.push_back(j);
+      }
+    }
+
+    GLuint count = this->indices.size() - offset;
+    this->objectRanges[i * 2] = offset;
+    this->objectRanges[i * 2 + 1] = count;
+    this->maxClusterLights = std::max(this->maxClusterLights, count);
+  }
+  this->indexCount = this->indices.size();
+  this->listed = true;
+
+  upload(this->buffers[2], this->indices.data(),
+      this->indices.size() * sizeof(GLuint), sizeof(GLuint));
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+  std::chrono::duration<double, std::milli> elapsed =
+    std::chrono::steady_clock::now() - start;
+  this->binMilliseconds = elapsed.count();
+}
+
+void LightClusters::bind(const Shader& shader, GLuint firstUnit,
+    GLuint width, GLuint height) {
+  const char* samplers[3] = { "lightData", "clusterGrid", "clusterLights" };
+  for (GLuint i = 0; i < 3; i++) {
+    glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+    glBindTexture(GL_TEXTURE_BUFFER, this->textures[i]);
+    glUniform1i(glGetUniformLocation(shader.program, samplers[i]),
+        firstUnit + i);
+  }
+
+  GLfloat depthScale = kClusterZ / logf(this->far / this->near);
+  glUniform1i(glGetUniformLocation(shader.program, "lightCount"),
+      this->lightCount);
+  glUniform1i(glGetUniformLocation(shader.program, "clustered"),
+      this->clustered);
+  glUniform1i(glGetUniformLocation(shader.program, "listed"), this->listed);
+  glUniform3i(glGetUniformLocation(shader.program, "clusterCount"),
+      kClusterX, kClusterY, kClusterZ);
+  glUniform2f(glGetUniformLocation(shader.program, "clusterScale"),
+      (GLfloat)kClusterX / width, (GLfloat)kClusterY / height);
+  glUniform2f(glGetUniformLocation(shader.program, "clusterDepth"),
+      depthScale, depthScale * logf(this->near));
+  glUniform2f(glGetUniformLocation(shader.program, "depthRange"),
+      this->near, this->far);
+}
+
+void LightClusters::bindObject(const Shader& shader, GLuint object) {
+  glUniform2i(glGetUniformLocation(shader.program, "objectLights"),
+      this->objectRanges[object * 2], this->objectRanges[object * 2 + 1]);
+}
+
+void LightClusters::bin(const std::vector<PointLight>& lights,
+    const PerspectiveCamera& camera) {
+  auto start = std::chrono::steady_clock::now();
+
+  // Light spheres in view space, with z flipped so depth grows into the
+  // screen.
+  std::vector<glm::vec4> spheres(lights.size());
+  for (size_t i = 0; i < lights.size(); i++) {
+    glm::vec4 position = camera.view * glm::vec4(lights[i].position, 1.0f);
+    spheres[i] = glm::vec4(position.x, position.y, -position.z,
+        lights[i].radius);
+  }
+
+  const GLfloat scaleX = camera.projection[0][0];
+  const GLfloat scaleY = camera.projection[1][1];
+  const GLfloat depthRatio = this->far / this->near;
+
+  // Every slice is binned by its own task so no two workers ever touch the
+  // same froxel.
+  std::vector<std::future<void>> tasks;
+  for (GLuint z = 0; z < kClusterZ; z++) {
+    tasks.push_back(ThreadPool::shared().submit([&, z]() {
+      GLfloat sliceNear = this->near *
+        powf(depthRatio, (GLfloat)z / kClusterZ);
+      GLfloat sliceFar = this->near *
+        powf(depthRatio, (GLfloat)(z + 1) / kClusterZ);
+
+      for (GLuint i = 0; i < kClusterX * kClusterY; i++) {
+        this->clusterLights[z * kClusterX * kClusterY + i].clear();
+      }
+
+      for (GLuint i = 0; i < spheres.size(); i++) {
+        const glm::vec4& sphere = spheres[i];
+
+        // Part of the slice the sphere's depth range overlaps.
+        GLfloat depthNear = std::max(sliceNear, sphere.z - sphere.w);
+        GLfloat depthFar = std::min(sliceFar, sphere.z + sphere.w);
+        if (depthNear > depthFar) {
+          continue;
+        }
+
+        // Project the sides of the sphere's bounding box. A side left of the
+        // view axis reaches furthest out where it is closest to the camera,
+        // a side right of it where it is furthest away, and the same for up
+        // and down.
+        GLfloat left = sphere.x - sphere.w;
+        GLfloat right = sphere.x + sphere.w;
+        GLfloat bottom = sphere.y - sphere.w;
+        GLfloat top = sphere.y + sphere.w;
+        left *= scaleX / (left < 0.0f ? depthNear : depthFar);
+        right *= scaleX / (right > 0.0f ? depthNear : depthFar);
+        bottom *= scaleY / (bottom < 0.0f ? depthNear : depthFar);
+        top *= scaleY / (top > 0.0f ? depthNear : depthFar);
+        if (left > 1.0f || right < -1.0f || bottom > 1.0f || top < -1.0f) {
+          continue;
+        }
+
+        GLint x0 = tile(left, kClusterX), x1 = tile(right, kClusterX);
+        GLint y0 = tile(bottom, kClusterY), y1 = tile(top, kClusterY);
+        for (GLint y = y0; y <= y1; y++) {
+          for (GLint x = x0; x <= x1; x++) {
+            this->clusterLights[(z * kClusterY + y) * kClusterX + x]
+              .push_back(i);
+          }
+        }
+      }
+    }));
+  }
+  for (std::future<void>& task : tasks) {
+    task.wait();
+  }
+
+  // Pack the per froxel lists into one index list.
+  this->indices.clear();
+  this->maxClusterLights = 0;
+  for (GLuint i = 0; i < kClusterCount; i++) {
+    const std::vector<GLuint>& lightsInCluster = this->clusterLights[i];
+    this->grid[i * 2] = this->indices.size();
+    this->grid[i * 2 + 1] = lightsInCluster.size();
+    this->indices.insert(this->indices.end(), lightsInCluster.begin(),
+        lightsInCluster.end());
+    this->maxClusterLights = std::max(this->maxClusterLights,
+        (GLuint)lightsInCluster.size());
+  }
+  this->indexCount = this->indices.size();
+
+  std::chrono::duration<double, std::milli> elapsed =
+    std::chrono::steady_clock::now() - start;
+  this->binMilliseconds = elapsed.count();
+}
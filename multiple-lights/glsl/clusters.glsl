@@ -0,0 +1,81 @@
+#ifndef CLUSTERS_GLSL
+#define CLUSTERS_GLSL
+
+#include "lighting.glsl"
+
+// Point lights read from the texture buffers filled by LightClusters. When
+// clustered is set, fragments only loop over the lights binned into their
+// froxel of the view frustum, when listed is set over the lights reaching the
+// object drawn, otherwise over all of them.
+
+uniform samplerBuffer lightData;      // Four texels per light.
+uniform usamplerBuffer clusterGrid;   // Offset and count into clusterLights.
+uniform usamplerBuffer clusterLights; // Light indices.
+
+uniform int lightCount;
+uniform bool clustered;
+uniform bool listed;
+uniform ivec2 objectLights; // Offset and count into clusterLights.
+uniform ivec3 clusterCount;
+uniform vec2 clusterScale; // Froxels per pixel.
+uniform vec2 clusterDepth; // Slices per unit of log depth, and log(near) * it.
+uniform vec2 depthRange;   // Camera near and far planes.
+
+PointLight fetchPointLight(int index) {
+  vec4 positionRadius = texelFetch(lightData, index * 4);
+  vec4 ambientConstant = texelFetch(lightData, index * 4 + 1);
+  vec4 diffuseLinear = texelFetch(lightData, index * 4 + 2);
+  vec4 specularQuadratic = texelFetch(lightData, index * 4 + 3);
+
+  PointLight light;
+  light.position = positionRadius.xyz;
+  light.radius = positionRadius.w;
+  light.ambient = ambientConstant.rgb;
+  light.constant = ambientConstant.a;
+  light.diffuse = diffuseLinear.rgb;
+  light.linear = diffuseLinear.a;
+  light.specular = specularQuadratic.rgb;
+  light.quadratic = specularQuadratic.a;
+  return light;
+}
+
+// Froxel the fragment falls into, slices are found from the view space depth
+// reconstructed from the depth buffer value.
+int clusterIndex() {
+  float near = depthRange.x;
+  float far = depthRange.y;
+  float ndcDepth = gl_FragCoord.z * 2.0f - 1.0f;
+  float depth = 2.0f * near * far / (far + near - ndcDepth * (far - near));
+
+  ivec3 cluster;
+  cluster.xy = ivec2(gl_FragCoord.xy * clusterScale);
+  cluster.z = int(log(depth) * clusterDepth.x - clusterDepth.y);
+  cluster = clamp(cluster, ivec3(0), clusterCount - 1);
+
+  return (cluster.z * clusterCount.y + cluster.y) * clusterCount.x +
+    cluster.x;
+}
+
+vec3 calcPointLights(Surface surface) {
+  int first = 0;
+  int count = lightCount;
+  if (clustered) {
+    uvec2 range = texelFetch(clusterGrid, clusterIndex()).rg;
+    first = int(range.x);
+    count = int(range.y);
+  } else if (listed) {
+    first = objectLights.x;
+    count = objectLights.y;
+  }
+
+  vec3 result = vec3(0.0f);
+  for (int i = 0; i < count; i++) {
+    int index = clustered || listed ?
+      int(texelFetch(clusterLights, first + i).r) : i;
+    result += calcPointLight(fetchPointLight(index), surface);
+  }
+
+  return result;
+}
+
+#endif
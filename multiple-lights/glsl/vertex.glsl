@@ -15,6 +15,9 @@ uniform mat4 projection;
 // Stripped version of the model matrix without the translation information.
 uniform mat3 normalMatrix;
 
+// Must match glsl/depthvertex.glsl exactly for the depth prepass.
+invariant gl_Position;
+
 void main() {
   // Get the fragment position by getting the vertex position in world space
   // and letting OpenGL interpolate it (since we are using out).
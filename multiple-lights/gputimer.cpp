@@ -0,0 +1,65 @@
+#include "gputimer.h"
+
+GpuTimer::GpuTimer() : first(0), pending(0), total(0), count(0) {
+  glGenQueries(kQueryCount, this->queries);
+}
+
+GpuTimer::~GpuTimer() {
+  glDeleteQueries(kQueryCount, this->queries);
+}
+
+void GpuTimer::begin() {
+  // Every query is in flight, the oldest has to be read before reusing it.
+  collect(this->pending == kQueryCount);
+
+  GLuint index = (this->first + this->pending) % kQueryCount;
+  glBeginQuery(GL_TIME_ELAPSED, this->queries[index]);
+}
+
+void GpuTimer::end() {
+  glEndQuery(GL_TIME_ELAPSED);
+  this->pending++;
+}
+
+double GpuTimer::milliseconds() {
+  collect(false);
+  if (this->count == 0) {
+    return 0.0;
+  }
+
+  return this->total / 1.0e6 / this->count;
+}
+
+GLuint GpuTimer::samples() {
+  collect(false);
+  return this->count;
+}
+
+void GpuTimer::reset() {
+  this->total = 0;
+  this->count = 0;
+}
+
+void GpuTimer::collect(bool wait) {
+  // Results come back in the order the queries were issued.
+  while (this->pending > 0) {
+    GLuint query = this->queries[this->first];
+
+    if (!wait) {
+      GLint available;
+      glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+      if (!available) {
+        break;
+      }
+    }
+
+    GLuint64 elapsed;
+    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+    this->total += elapsed;
+    this->count++;
+
+    this->first = (this->first + 1) % kQueryCount;
+    this->pending--;
+    wait = false;
+  }
+}
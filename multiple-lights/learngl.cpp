@@ -1,8 +1,12 @@
+#include <algorithm>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <math.h>
+#include <random>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -14,6 +18,9 @@ extern "C" {
 #include <SOIL/SOIL.h>
 }
 
+#include "cluster.h"
+#include "gputimer.h"
+#include "lighting.h"
 #include "shader.h"
 #include "perspectivecamera.h"
 
@@ -21,8 +28,17 @@ extern "C" {
 const GLuint kWindowWidth = 800;
 const GLuint kWindowHeight = 600;
 
+// Steps the scene through kBenchmarkMinLights to kBenchmarkMaxLights random
+// point lights, doubling the count every step, and draws each light count for
+// a while in every shading mode. The GPU time spent shading the containers and
+// the CPU time spent binning are dumped to stdout.
+const bool kBenchmarkLights = false;
+const GLuint kBenchmarkMinLights = 4;
+const GLuint kBenchmarkMaxLights = 1024;
+const GLuint kBenchmarkWarmupFrames = 10;
+const GLuint kBenchmarkFrames = 110;
+
 glm::mat4 model;
-glm::mat3 normal;
 
 // Perspecitve camera for 3D fun.
 PerspectiveCamera camera;
@@ -47,10 +63,33 @@ bool firstMouseEvent = true;
 // Keyboard state.
 bool keys[1024];
 
+// How the containers are lit, cycled through with C. Forward shading loops
+// over every point light per fragment, listed shading only over the lights
+// reaching the container drawn, and clustered shading only over the lights
+// binned into the fragment's cluster.
+enum class ShadingMode {
+  Forward,
+  Listed,
+  Clustered
+};
+const GLuint kShadingModeCount = 3;
+ShadingMode shadingMode = ShadingMode::Clustered;
+
+// Whether the containers are drawn into the depth buffer first so the lit pass
+// only shades the visible fragment of every pixel, toggled with P.
+bool depthPrepass = true;
+
+// Sets up the scene and renders it until the window is closed, returns the
+// exit status.
+int run(GLFWwindow* window, int fbWidth, int fbHeight);
+
 // Utility functions.
 GLuint loadTexture(std::string filepath);
+GLuint loadMaterialTexture(std::string diffusePath, std::string specularPath);
 void move(GLfloat delta);
 GLfloat easeOutQuart(GLfloat t, GLfloat b, GLfloat c, GLfloat d);
+std::vector<PointLight> randomPointLights(GLuint count);
+const char* shadingModeName(ShadingMode mode);
 
 // Callbacks.
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mode);
@@ -103,13 +142,25 @@ int main() {
   // prevent overlapping polygon artifacts.
   glEnable(GL_DEPTH_TEST);
 
+  // Everything owning GL objects lives in run so it gets deleted before the
+  // context goes away with glfwTerminate.
+  int status = run(window, fbWidth, fbHeight);
+
+  // Terminate GLFW and clean any resources before exiting.
+  glfwTerminate();
+
+  return status;
+}
+
+int run(GLFWwindow* window, int fbWidth, int fbHeight) {
   // Read and compile the vertex and fragment shaders using
   // the shader helper class.
   Shader shader("glsl/vertex.glsl", "glsl/fragment.glsl");
   Shader lampShader("glsl/lampvertex.glsl", "glsl/lampfragment.glsl");
+  Shader depthShader("glsl/depthvertex.glsl", "glsl/depthfragment.glsl");
 
-  GLuint containerTexture = loadTexture("assets/container2.png");
-  GLuint containerSpecular = loadTexture("assets/container2_specular.png");
+  GLuint containerTexture = loadMaterialTexture("assets/container2.png",
+      "assets/container2_specular.png");
   GLuint containerEmission = loadTexture("assets/matrix.jpg");
 
   // Container mesh data.
@@ -171,6 +222,19 @@ int main() {
     glm::vec3(-1.3f,  1.0f, -1.5f)
   };
 
+  // World and normal matrices of the containers. They don't move, so the draw
+  // list is built once and shared by the depth prepass and the lit pass.
+  std::vector<glm::mat4> containerModels;
+  std::vector<glm::mat3> containerNormals;
+  for (GLuint i = 0; i < 10; i++) {
+    model = glm::mat4();
+    model = glm::translate(model, cubePositions[i]);
+    model = glm::rotate(model, i * 20.0f, glm::vec3(1.0f, 0.3f, 0.5f));
+    containerModels.push_back(model);
+    // Calculate the normal matrix on the CPU (keep them normals perpendicular).
+    containerNormals.push_back(glm::mat3(glm::transpose(glm::inverse(model))));
+  }
+
   // Create a VBO to store the vertex data, an EBO to store indice data, and
   // create a VAO to retain our vertex attribute pointers.
   GLuint VBO, VAO;
@@ -224,12 +288,99 @@ int main() {
     glm::vec3( 0.0f,  0.0f, -3.0f)
   };
 
+  // Point lights of the scene, handed to the shaders through the light
+  // buffers.
+  const glm::vec3 pointLightColors[] = {
+    glm::vec3(1.0f, 0.0f, 0.0f),
+    glm::vec3(0.0f, 1.0f, 0.0f),
+    glm::vec3(0.0f, 0.0f, 1.0f),
+    glm::vec3(0.8f, 0.8f, 0.8f)
+  };
+  std::vector<PointLight> pointLights;
+  for (GLuint i = 0; i < 4; i++) {
+    pointLights.push_back(makePointLight(pointLightPositions[i],
+        glm::vec3(0.05f), pointLightColors[i], glm::vec3(1.0f), 1.0f, 0.09f,
+        0.032f));
+  }
+
+  // The spot light is at most white, so its reach only depends on the
+  // attenuation.
+  const GLfloat attenuationRadius = lightRadius(1.0f, 0.09f, 0.032f, 1.0f);
+
+  // Light buffers and the froxel grid the point lights are binned into.
+  LightClusters lightClusters;
+
+  // Spheres bounding the containers in any orientation, reaching out to the
+  // corners of the unit cube. Lights are listed per container against them.
+  std::vector<glm::vec4> containerBounds;
+  for (GLuint i = 0; i < 10; i++) {
+    containerBounds.push_back(glm::vec4(cubePositions[i], sqrtf(3.0f) * 0.5f));
+  }
+
+  // Light benchmark progress, see kBenchmarkLights. Every light count takes
+  // a step per shading mode.
+  GLuint benchmarkStep = 0;
+  GLuint benchmarkFrame = 0;
+  double benchmarkBinTime = 0.0;
+  if (kBenchmarkLights) {
+    pointLights = randomPointLights(kBenchmarkMinLights);
+    shadingMode = ShadingMode::Forward;
+    std::cout << "lights  mode       shading (GPU)  binning (CPU)  " <<
+      "max per cluster" << std::endl;
+  }
+
+  // Times the depth prepass and the lit containers on the GPU, shown in the
+  // window title every second.
+  GpuTimer prepassTimer;
+  GpuTimer lightingTimer;
+  GLfloat lastReport = 0.0f;
+
+  // Last reported time of both passes together without and with the depth
+  // prepass, so the two can be compared after toggling it.
+  double frameMilliseconds[2] = { 0.0, 0.0 };
+  bool timedPrepass = depthPrepass;
+
   // Render loop.
   while (!glfwWindowShouldClose(window)) {
     GLfloat currentFrame = glfwGetTime();
     delta = currentFrame - lastFrame;
     lastFrame = currentFrame;
 
+    // Move the light benchmark along. Measuring only starts a few frames into
+    // each step so no timings of the previous step are still in flight.
+    if (kBenchmarkLights) {
+      benchmarkFrame++;
+      if (benchmarkFrame == kBenchmarkWarmupFrames) {
+        prepassTimer.reset();
+        lightingTimer.reset();
+        benchmarkBinTime = 0.0;
+      } else if (benchmarkFrame == kBenchmarkFrames) {
+        GLuint frames = kBenchmarkFrames - kBenchmarkWarmupFrames;
+        std::cout << std::setw(6) << pointLights.size() << "  " <<
+          std::setw(9) << std::left << shadingModeName(shadingMode) <<
+          std::right <<
+          std::fixed << std::setprecision(3) <<
+          std::setw(12) << prepassTimer.milliseconds() +
+            lightingTimer.milliseconds() << " ms" <<
+          std::setw(12) << benchmarkBinTime / frames << " ms" <<
+          std::setw(17) << lightClusters.maxClusterLights << std::endl;
+
+        benchmarkStep++;
+        benchmarkFrame = 0;
+        GLuint count = kBenchmarkMinLights <<
+          (benchmarkStep / kShadingModeCount);
+        if (count > kBenchmarkMaxLights) {
+          glfwSetWindowShouldClose(window, GL_TRUE);
+        }
+        shadingMode = (ShadingMode)(benchmarkStep % kShadingModeCount);
+        pointLights = randomPointLights(std::min(count, kBenchmarkMaxLights));
+      }
+      if (shadingMode == ShadingMode::Listed ||
+          shadingMode == ShadingMode::Clustered) {
+        benchmarkBinTime += lightClusters.binMilliseconds;
+      }
+    }
+
     // Check and call events.
     glfwPollEvents();
     move(delta);
@@ -248,8 +399,40 @@ int main() {
     camera.fov = easeOutQuart(fovTime, startFov, (startFov - targetFov) * -1, limitTime);
     camera.update();
 
-    // Bind the VAO and shader.
+    // Don't mix timings of both modes after the prepass was toggled.
+    if (depthPrepass != timedPrepass) {
+      prepassTimer.reset();
+      lightingTimer.reset();
+      timedPrepass = depthPrepass;
+      lastReport = currentFrame;
+    }
+
+    // Bind the VAO.
     glBindVertexArray(VAO);
+
+    // Lay down the depth of the containers without any shading, the lit pass
+    // then only passes the depth test where it matches.
+    if (depthPrepass) {
+      depthShader.use();
+      glUniformMatrix4fv(glGetUniformLocation(depthShader.program, "view"), 1,
+          GL_FALSE, glm::value_ptr(camera.view));
+      glUniformMatrix4fv(glGetUniformLocation(depthShader.program,
+            "projection"), 1, GL_FALSE, glm::value_ptr(camera.projection));
+      GLuint depthModelMatrix = glGetUniformLocation(depthShader.program,
+          "model");
+
+      prepassTimer.begin();
+      glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+      for (GLuint i = 0; i < containerModels.size(); i++) {
+        glUniformMatrix4fv(depthModelMatrix, 1, GL_FALSE,
+            glm::value_ptr(containerModels[i]));
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+      }
+      glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+      prepassTimer.end();
+    }
+
+    // Bind the shader.
     shader.use();
 
     // Pass the view and projection matrices from the camera.
@@ -269,41 +452,14 @@ int main() {
     glUniform3f(glGetUniformLocation(shader.program, "dirLight.diffuse"), 0.4f, 0.4f, 0.4f);
     glUniform3f(glGetUniformLocation(shader.program, "dirLight.specular"), 0.5f, 0.5f, 0.5f);
 
-    // Point light 1
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[0].position"), pointLightPositions[0].x, pointLightPositions[0].y, pointLightPositions[0].z);
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[0].ambient"), 0.05f, 0.05f, 0.05f);
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[0].diffuse"), 1.0f, 0.0f, 0.0f);
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[0].specular"), 1.0f, 1.0f, 1.0f);
-    glUniform1f(glGetUniformLocation(shader.program, "pointLights[0].constant"), 1.0f);
-    glUniform1f(glGetUniformLocation(shader.program, "pointLights[0].linear"), 0.09);
-    glUniform1f(glGetUniformLocation(shader.program, "pointLights[0].quadratic"), 0.032);
-
-    // Point light 2
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[1].position"), pointLightPositions[1].x, pointLightPositions[1].y, pointLightPositions[1].z);
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[1].ambient"), 0.05f, 0.05f, 0.05f);
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[1].diffuse"), 0.0f, 1.0f, 0.0f);
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[1].specular"), 1.0f, 1.0f, 1.0f);
-    glUniform1f(glGetUniformLocation(shader.program, "pointLights[1].constant"), 1.0f);
-    glUniform1f(glGetUniformLocation(shader.program, "pointLights[1].linear"), 0.09);
-    glUniform1f(glGetUniformLocation(shader.program, "pointLights[1].quadratic"), 0.032);
-
-    // Point light 3
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[2].position"), pointLightPositions[2].x, pointLightPositions[2].y, pointLightPositions[2].z);
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[2].ambient"), 0.05f, 0.05f, 0.05f);
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[2].diffuse"), 0.0f, 0.0f, 1.0f);
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[2].specular"), 1.0f, 1.0f, 1.0f);
-    glUniform1f(glGetUniformLocation(shader.program, "pointLights[2].constant"), 1.0f);
-    glUniform1f(glGetUniformLocation(shader.program, "pointLights[2].linear"), 0.09);
-    glUniform1f(glGetUniformLocation(shader.program, "pointLights[2].quadratic"), 0.032);
-
-    // Point light 4
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[3].position"), pointLightPositions[3].x, pointLightPositions[3].y, pointLightPositions[3].z);
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[3].ambient"), 0.05f, 0.05f, 0.05f);
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[3].diffuse"), 0.8f, 0.8f, 0.8f);
-    glUniform3f(glGetUniformLocation(shader.program, "pointLights[3].specular"), 1.0f, 1.0f, 1.0f);
-    glUniform1f(glGetUniformLocation(shader.program, "pointLights[3].constant"), 1.0f);
-    glUniform1f(glGetUniformLocation(shader.program, "pointLights[3].linear"), 0.09);
-    glUniform1f(glGetUniformLocation(shader.program, "pointLights[3].quadratic"), 0.032);
+    // Point lights, binned into the clusters they reach when clustering or
+    // listed per container they reach when listing.
+    lightClusters.update(pointLights, camera,
+        shadingMode == ShadingMode::Clustered);
+    if (shadingMode == ShadingMode::Listed) {
+      lightClusters.listObjects(pointLights, containerBounds);
+    }
+    lightClusters.bind(shader, 2, fbWidth, fbHeight);
 
     // Sport light 1
     glUniform3f(glGetUniformLocation(shader.program, "spotLights[0].position"), camera.position.x, camera.position.y, camera.position.z);
@@ -314,18 +470,17 @@ int main() {
     glUniform1f(glGetUniformLocation(shader.program, "spotLights[0].constant"), 1.0f);
     glUniform1f(glGetUniformLocation(shader.program, "spotLights[0].linear"), 0.09);
     glUniform1f(glGetUniformLocation(shader.program, "spotLights[0].quadratic"), 0.032);
+    glUniform1f(glGetUniformLocation(shader.program, "spotLights[0].radius"), attenuationRadius);
     glUniform1f(glGetUniformLocation(shader.program, "spotLights[0].cutoff"), glm::cos(glm::radians(12.5f)));
     glUniform1f(glGetUniformLocation(shader.program, "spotLights[0].outerCutoff"), glm::cos(glm::radians(15.5f)));
 
     // Pass material values.
     GLuint materialShininess = glGetUniformLocation(shader.program, "material.shininess");
     GLuint materialDiffuse   = glGetUniformLocation(shader.program, "material.diffuse");
-    GLuint materialSpecular  = glGetUniformLocation(shader.program, "material.specular");
     GLuint materialEmission  = glGetUniformLocation(shader.program, "material.emission");
     glUniform1f(materialShininess, 64.0f);
     glUniform1i(materialDiffuse, 0);
-    glUniform1i(materialSpecular, 1);
-    glUniform1i(materialEmission, 2);
+    glUniform1i(materialEmission, 1);
 
     // Misc values.
     GLuint viewPos = glGetUniformLocation(shader.program, "viewPos");
@@ -335,25 +490,54 @@ int main() {
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, containerTexture);
     glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, containerSpecular);
-    glActiveTexture(GL_TEXTURE2);
     glBindTexture(GL_TEXTURE_2D, containerEmission);
 
     // Draw multiple containers!
     GLuint modelMatrix = glGetUniformLocation(shader.program, "model");
     GLuint normalMatrix = glGetUniformLocation(shader.program, "normalMatrix");
-    for (GLuint i = 0; i < 10; i++) {
-      // Apply world transformations.
-      model = glm::mat4();
-      model = glm::translate(model, cubePositions[i]);
-      model = glm::rotate(model, i * 20.0f, glm::vec3(1.0f, 0.3f, 0.5f));
-      glUniformMatrix4fv(modelMatrix, 1, GL_FALSE, glm::value_ptr(model));
-      // Calculate the normal matrix on the CPU (keep them normals perpendicular).
-      normal = glm::mat3(glm::transpose(glm::inverse(model)));
-      glUniformMatrix3fv(normalMatrix, 1, GL_FALSE, glm::value_ptr(normal));
+    // With the prepass the depth buffer already holds the nearest surfaces,
+    // so only fragments with exactly that depth get shaded and nothing needs
+    // to be written.
+    if (depthPrepass) {
+      glDepthFunc(GL_EQUAL);
+      glDepthMask(GL_FALSE);
+    }
+    lightingTimer.begin();
+    for (GLuint i = 0; i < containerModels.size(); i++) {
+      glUniformMatrix4fv(modelMatrix, 1, GL_FALSE,
+          glm::value_ptr(containerModels[i]));
+      glUniformMatrix3fv(normalMatrix, 1, GL_FALSE,
+          glm::value_ptr(containerNormals[i]));
+      // Only shade the lights reaching this container when listing.
+      if (shadingMode == ShadingMode::Listed) {
+        lightClusters.bindObject(shader, i);
+      }
       // Draw the container.
       glDrawArrays(GL_TRIANGLES, 0, 36);
     }
+    lightingTimer.end();
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+
+    // Show the average time spent on the containers every second, and how
+    // long they took the last time with the prepass the other way around.
+    if (!kBenchmarkLights && currentFrame - lastReport >= 1.0f) {
+      frameMilliseconds[depthPrepass] = prepassTimer.milliseconds() +
+        lightingTimer.milliseconds();
+
+      std::ostringstream title;
+      title << "LearnGL (" << shadingModeName(shadingMode) << " lighting " <<
+        lightingTimer.milliseconds() << " ms";
+      if (depthPrepass) {
+        title << " + prepass " << prepassTimer.milliseconds() << " ms";
+      }
+      title << ", prepass on " << frameMilliseconds[true] << " ms / off " <<
+        frameMilliseconds[false] << " ms)";
+      glfwSetWindowTitle(window, title.str().c_str());
+      prepassTimer.reset();
+      lightingTimer.reset();
+      lastReport = currentFrame;
+    }
     glBindVertexArray(0);
 
     // Bind the VAO and shader.
@@ -388,9 +572,6 @@ int main() {
   glDeleteVertexArrays(1, &VAO);
   glDeleteBuffers(1, &VBO);
 
-  // Terminate GLFW and clean any resources before exiting.
-  glfwTerminate();
-
   return 0;
 }
 
@@ -421,6 +602,67 @@ GLuint loadTexture(std::string filepath) {
   return texture;
 }
 
+GLuint loadMaterialTexture(std::string diffusePath, std::string specularPath) {
+  // Load both maps, the specular map gets reduced to a single intensity.
+  int width, height, specularWidth, specularHeight;
+  unsigned char* diffuse = SOIL_load_image(diffusePath.c_str(), &width, &height, 0, SOIL_LOAD_RGB);
+  unsigned char* specular = SOIL_load_image(specularPath.c_str(), &specularWidth, &specularHeight, 0, SOIL_LOAD_RGB);
+
+  // Without a diffuse map there is nothing to pack, texture 0 samples black.
+  if (diffuse == nullptr) {
+    std::cerr << "ERROR: Unable to load texture " << diffusePath << ": " <<
+      SOIL_last_result() << std::endl;
+    if (specular != nullptr) {
+      SOIL_free_image_data(specular);
+    }
+    return 0;
+  }
+
+  // A missing specular map just means no highlights.
+  if (specular == nullptr) {
+    std::cerr << "ERROR: Unable to load texture " << specularPath << ": " <<
+      SOIL_last_result() << std::endl;
+  }
+
+  // Pack the diffuse color into rgb and the specular intensity into alpha.
+  // The specular map is sampled with nearest filtering in case its size
+  // doesn't match.
+  std::vector<GLubyte> packed(width * height * 4);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      GLubyte* texel = &packed[(y * width + x) * 4];
+      const unsigned char* color = &diffuse[(y * width + x) * 3];
+      texel[0] = color[0];
+      texel[1] = color[1];
+      texel[2] = color[2];
+      texel[3] = 0;
+      if (specular != nullptr) {
+        const unsigned char* intensity = &specular[
+          ((y * specularHeight / height) * specularWidth +
+           x * specularWidth / width) * 3];
+        texel[3] = (GLubyte)((intensity[0] * 54 + intensity[1] * 183 +
+          intensity[2] * 19) >> 8);
+      }
+    }
+  }
+
+  SOIL_free_image_data(diffuse);
+  if (specular != nullptr) {
+    SOIL_free_image_data(specular);
+  }
+
+  GLuint texture;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, packed.data());
+  glGenerateMipmap(GL_TEXTURE_2D);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  return texture;
+}
+
 void move(GLfloat delta) {
   GLfloat cameraSpeed = 5.0f * delta;
 
@@ -449,6 +691,50 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mode
   if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
     glfwSetWindowShouldClose(window, GL_TRUE);
   }
+
+  // Cycle through forward, listed and clustered shading.
+  if (key == GLFW_KEY_C && action == GLFW_PRESS) {
+    GLuint next = ((GLuint)shadingMode + 1) % kShadingModeCount;
+    shadingMode = (ShadingMode)next;
+  }
+
+  // Switch the depth prepass on and off.
+  if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+    depthPrepass = !depthPrepass;
+  }
+}
+
+const char* shadingModeName(ShadingMode mode) {
+  switch (mode) {
+    case ShadingMode::Forward:
+      return "forward";
+    case ShadingMode::Listed:
+      return "listed";
+    case ShadingMode::Clustered:
+      return "clustered";
+  }
+  return "";
+}
+
+std::vector<PointLight> randomPointLights(GLuint count) {
+  // Seeded by the count so every run benchmarks the same lights.
+  std::mt19937 random(count);
+  std::uniform_real_distribution<GLfloat> x(-6.0f, 6.0f);
+  std::uniform_real_distribution<GLfloat> y(-4.0f, 6.0f);
+  std::uniform_real_distribution<GLfloat> z(-16.0f, 2.0f);
+  std::uniform_real_distribution<GLfloat> color(0.2f, 1.0f);
+
+  // Short ranged lights, a few units each, so they are spread over the scene
+  // rather than all of them lighting everything.
+  std::vector<PointLight> lights;
+  for (GLuint i = 0; i < count; i++) {
+    glm::vec3 position(x(random), y(random), z(random));
+    glm::vec3 diffuse(color(random), color(random), color(random));
+    lights.push_back(makePointLight(position, glm::vec3(0.0f), diffuse,
+        diffuse, 1.0f, 0.7f, 1.8f));
+  }
+
+  return lights;
 }
 
 void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
@@ -0,0 +1,39 @@
+#ifndef LIGHTING_H
+#define LIGHTING_H
+
+#include <glm/glm.hpp>
+
+extern "C" {
+#include <GL/glew.h>
+}
+
+// Light contributions dimmer than this (in 8-bit color steps) are treated as
+// zero, which is what gives point and spot lights a finite radius.
+const GLfloat kLightCutoff = 5.0f / 256.0f;
+
+// Distance at which the constant/linear/quadratic attenuation of a light whose
+// brightest color channel is intensity falls below kLightCutoff. Passed to the
+// shaders as the light radius so fragments past it can skip the light.
+GLfloat lightRadius(GLfloat constant, GLfloat linear, GLfloat quadratic,
+    GLfloat intensity);
+
+// Point light laid out the way the shaders read it from the light buffer, as
+// four RGBA texels (see fetchPointLight in glsl/clusters.glsl).
+struct PointLight {
+  glm::vec3 position;
+  GLfloat radius;
+  glm::vec3 ambient;
+  GLfloat constant;
+  glm::vec3 diffuse;
+  GLfloat linear;
+  glm::vec3 specular;
+  GLfloat quadratic;
+};
+
+// Fills in a point light, deriving its radius from the attenuation and the
+// brightest of its colors.
+PointLight makePointLight(glm::vec3 position, glm::vec3 ambient,
+    glm::vec3 diffuse, glm::vec3 specular, GLfloat constant, GLfloat linear,
+    GLfloat quadratic);
+
+#endif
@@ -21,6 +21,8 @@ class Shader {
     void use();
   private:
     // Reads a shader (or any file for that matter) and puts it into a string.
+    // Lines of the form #include "file" are replaced by the contents of that
+    // file, relative to the directory of the file being read.
     std::string readShader(std::string filepath);
 
     // Used to check if a shader compiled successfully.
@@ -0,0 +1,64 @@
+#include "threadpool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned int threads) : stopping(false) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  for (unsigned int i = 0; i < threads; i++) {
+    workers.push_back(std::thread(&ThreadPool::run, this));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  condition.notify_all();
+
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+std::future<void> ThreadPool::submit(std::function<void()> task) {
+  std::packaged_task<void()> packaged(task);
+  std::future<void> future = packaged.get_future();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    tasks.push(std::move(packaged));
+  }
+  condition.notify_one();
+
+  return future;
+}
+
+ThreadPool& ThreadPool::shared() {
+  static ThreadPool pool;
+  return pool;
+}
+
+void ThreadPool::run() {
+  while (true) {
+    std::packaged_task<void()> task;
+
+    {
+      // Sleep until there is work to do or the pool is going away. Remaining
+      // tasks are still drained when stopping so no future is left hanging.
+      std::unique_lock<std::mutex> lock(mutex);
+      condition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+      if (tasks.empty()) {
+        return;
+      }
+
+      task = std::move(tasks.front());
+      tasks.pop();
+    }
+
+    task();
+  }
+}
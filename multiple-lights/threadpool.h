@@ -0,0 +1,41 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+  public:
+    // Spawns the given amount of worker threads (0 uses every core).
+    explicit ThreadPool(unsigned int threads = 0);
+
+    // Finishes the queued tasks and joins the workers.
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Queues a task for the workers. The future becomes ready once the task
+    // has run.
+    std::future<void> submit(std::function<void()> task);
+
+    // Pool shared by all the per frame work so that nothing has to spawn a
+    // set of threads of its own.
+    static ThreadPool& shared();
+  private:
+    std::vector<std::thread> workers;
+    std::queue<std::packaged_task<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping;
+
+    // Worker loop, runs tasks until the pool is stopped.
+    void run();
+};
+
+#endif
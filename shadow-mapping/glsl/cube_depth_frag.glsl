@@ -0,0 +1,16 @@
+#version 330 core
+
+// Most point lights rendered per pass (kMaxPointShadows in pointshadows.h).
+#define MAX_POINT_SHADOWS 4
+
+in vec3 worldPosition;
+flat in int light;
+
+uniform vec4 lights[MAX_POINT_SHADOWS]; // Position and radius.
+
+void main() {
+  // Store the distance to the light linearly, so it can be compared against
+  // the distance of a fragment without knowing the face projection.
+  vec4 lightSphere = lights[light];
+  gl_FragDepth = length(worldPosition - lightSphere.xyz) / lightSphere.w;
+}
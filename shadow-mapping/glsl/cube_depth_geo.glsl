@@ -0,0 +1,50 @@
+#version 330 core
+
+// Most point lights rendered per pass (kMaxPointShadows in pointshadows.h).
+#define MAX_POINT_SHADOWS 4
+#define MAX_FACES (6 * MAX_POINT_SHADOWS)
+
+// Room to copy the triangle into every face (3 * MAX_FACES), layout
+// qualifiers only take plain numbers. Every vertex writes 12 components,
+// 864 in all, which has to stay within the 1024 GL 3.3 guarantees
+// (checked in pointshadows.cpp).
+layout (triangles) in;
+layout (triangle_strip, max_vertices = 72) out;
+
+out vec3 worldPosition;
+flat out int light; // Index of the light of the face.
+
+uniform mat4 faceMatrices[MAX_FACES];
+
+// Per face the center of its tile of the atlas in normalized device
+// coordinates, and its size relative to the atlas.
+uniform vec3 tiles[MAX_FACES];
+
+// Faces the caster overlaps, bit 6 * light + face.
+uniform int faceMask;
+
+void main() {
+  // Copy the triangle into the tile of every face it may be seen in instead
+  // of drawing the scene once per face.
+  for (int face = 0; face < MAX_FACES; face++) {
+    if ((faceMask & (1 << face)) == 0) {
+      continue;
+    }
+
+    for (int i = 0; i < 3; i++) {
+      // Clip against the face before shrinking it onto its tile, the rest of
+      // the triangle would land in the neighbouring tiles.
+      vec4 position = faceMatrices[face] * gl_in[i].gl_Position;
+      gl_ClipDistance[0] = position.w + position.x;
+      gl_ClipDistance[1] = position.w - position.x;
+      gl_ClipDistance[2] = position.w + position.y;
+      gl_ClipDistance[3] = position.w - position.y;
+      gl_Position = vec4(position.xy * tiles[face].z +
+        tiles[face].xy * position.w, position.zw);
+      worldPosition = gl_in[i].gl_Position.xyz;
+      light = face / 6;
+      EmitVertex();
+    }
+    EndPrimitive();
+  }
+}
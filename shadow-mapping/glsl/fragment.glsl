@@ -3,47 +3,233 @@
 // Why isn't this available in GLSL in the first place?
 #define PI 3.14159265
 
+// Most cascades there is room for (kMaxShadowCascades in shadowcascades.h).
+#define MAX_CASCADES 8
+
+// Most point lights with shadows (kMaxPointLights in pointshadows.h).
+#define MAX_POINT_LIGHTS 16
+
+// Lookups are pushed out along the normal by this many texels of their cascade
+// at grazing angles, and compared against the map with a bias of this many
+// texels, so surfaces don't shadow themselves (shadow acne).
+#define NORMAL_OFFSET 1.5f
+#define DEPTH_BIAS 1.0f
+
+// Shadow filters (ShadowFilter in shadowcascades.h).
+#define SHADOW_FILTER_PCF 0
+#define SHADOW_FILTER_HARDWARE_PCF 1
+#define SHADOW_FILTER_EXPONENTIAL 2
+
+// Sharpness of the exponential shadow maps, has to match
+// glsl/shadow_exp_frag.glsl. Higher values leak less light where casters are
+// close to receivers, but exp(ESM_EXPONENT) has to fit in a float.
+#define ESM_EXPONENT 80.0f
+
 // Interpolated mesh data.
 in GS_OUT {
   vec3 position;
   vec3 normal;
   vec2 uv;
-  vec4 lightSpacePos;
+  float viewDepth;
 } frag_in;
 
 out vec4 color; // Final fragment color.
 
-uniform vec3 lightPos;
+uniform vec3 lightDirection; // Direction the directional light shines in.
 uniform vec3 viewPos; // Used for specular calculation.
 
 uniform sampler2D diffuseTexture;
-uniform sampler2D shadowMap; // The shadow map for shadows.
 
-float calcShadow(vec4 lightSpacePos, vec3 normal, vec3 lightDir) {
-  vec3 projCoords = lightSpacePos.xyz / lightSpacePos.w;
-  projCoords = projCoords * 0.5f + 0.5f;
+// The cascaded shadow map, one cascade per tile of a depth atlas.
+uniform sampler2D shadowMap;
+uniform mat4 cascadeMatrices[MAX_CASCADES];
+uniform int cascadeCount;
+
+// The same depth atlas compared by the sampler, and the blurred exponential
+// depth of the cascades in the same tiles.
+uniform sampler2DShadow shadowMapCompare;
+uniform sampler2D shadowMapExponential;
+uniform int shadowFilter;
+
+// Per cascade: view depth its split ends at, world size of a texel and depth
+// range of its projection. Then the corner and size of its tile in texture
+// coordinates of the atlas.
+uniform vec3 cascades[MAX_CASCADES];
+uniform vec4 cascadeTiles[MAX_CASCADES];
+
+// Point lights (position and radius) and their shadows, six cube faces per
+// light in tiles of a shadow atlas. The tiles are the corner and size of the
+// face in the atlas, a size of 0 means the light has no shadows yet.
+uniform vec4 pointLights[MAX_POINT_LIGHTS];
+uniform int pointLightCount;
+uniform vec3 pointLightColor;
+uniform sampler2D pointShadowMap;
+uniform vec3 pointShadowTiles[6 * MAX_POINT_LIGHTS];
+
+// Right and up vectors of the cube faces (+X, -X, +Y, -Y, +Z, -Z) they were
+// rendered with in pointshadows.cpp.
+const vec3 faceRights[6] = vec3[6](
+  vec3(0.0f, 0.0f, -1.0f), vec3(0.0f, 0.0f, 1.0f), vec3(1.0f, 0.0f, 0.0f),
+  vec3(1.0f, 0.0f, 0.0f), vec3(1.0f, 0.0f, 0.0f), vec3(-1.0f, 0.0f, 0.0f));
+const vec3 faceUps[6] = vec3[6](
+  vec3(0.0f, -1.0f, 0.0f), vec3(0.0f, -1.0f, 0.0f), vec3(0.0f, 0.0f, 1.0f),
+  vec3(0.0f, 0.0f, -1.0f), vec3(0.0f, -1.0f, 0.0f), vec3(0.0f, -1.0f, 0.0f));
+
+float calcShadow(vec3 position, float viewDepth, vec3 normal, vec3 lightDir) {
+  // Pick the nearest cascade whose split contains the fragment, nothing past
+  // the last one is shadowed.
+  int cascade = 0;
+  while (cascade < cascadeCount && viewDepth > cascades[cascade].x) {
+    cascade++;
+  }
+  if (cascade == cascadeCount) {
+    return 0.0f;
+  }
+  float worldTexel = cascades[cascade].y;
+  float depthRange = cascades[cascade].z;
+  vec4 tile = cascadeTiles[cascade];
+
+  // Offsets are in texels of the cascade so they hold up for every cascade
+  // size instead of being tuned for one.
+  float cosTheta = clamp(dot(normal, lightDir), 0.0f, 1.0f);
+  float sinTheta = sqrt(1.0f - cosTheta * cosTheta);
+  vec3 offsetPosition = position + normal * (NORMAL_OFFSET * worldTexel *
+    sinTheta);
 
+  // The projection is orthographic so there's no need to divide by w.
+  vec4 lightSpacePos = cascadeMatrices[cascade] * vec4(offsetPosition, 1.0f);
+  vec3 projCoords = lightSpacePos.xyz * 0.5f + 0.5f;
   if (projCoords.z > 1.0f) {
     return 0.0f;
   }
 
-  float closestDepth = texture(shadowMap, projCoords.xy).r;
   float currentDepth = projCoords.z;
+  float bias = DEPTH_BIAS * worldTexel / depthRange;
+
+  // Keep the filter from reading the tiles of the other cascades.
+  vec2 texelSize = 1.0f / vec2(textureSize(shadowMap, 0));
+  vec2 uv = tile.xy + projCoords.xy * tile.zw;
+  vec2 minUv = tile.xy + 0.5f * texelSize;
+  vec2 maxUv = tile.xy + tile.zw - 0.5f * texelSize;
+
+  if (shadowFilter == SHADOW_FILTER_EXPONENTIAL) {
+    // The blurred exp(c * occluder) times exp(-c * receiver) is about 1 when
+    // lit and falls off quickly behind the occluders.
+    float occluder = texture(shadowMapExponential,
+      clamp(uv, minUv, maxUv)).r;
+    float lit = occluder * exp(-ESM_EXPONENT * (currentDepth - bias));
+    return 1.0f - clamp(lit, 0.0f, 1.0f);
+  }
+
+  float shadow = 0.0f;
+  if (shadowFilter == SHADOW_FILTER_HARDWARE_PCF) {
+    // Every fetch blends the compares of a 2x2 texel block, four of them half
+    // a texel apart cover the same 3x3 texels as below with tent weights.
+    for (int x = 0; x <= 1; ++x) {
+      for (int y = 0; y <= 1; ++y) {
+        vec2 offsetUv = clamp(uv + (vec2(x, y) - 0.5f) * texelSize, minUv,
+          maxUv);
+        shadow += texture(shadowMapCompare,
+          vec3(offsetUv, currentDepth - bias));
+      }
+    }
+    return 1.0f - shadow / 4.0f;
+  }
+
+  for (int x = -1; x <= 1; ++x) {
+    for (int y = -1; y <= 1; ++y) {
+      vec2 offsetUv = clamp(uv + vec2(x, y) * texelSize, minUv, maxUv);
+      float pcfDepth = texture(shadowMap, offsetUv).r;
+      shadow += currentDepth - bias > pcfDepth ? 1.0f : 0.0f;
+    }
+  }
+  shadow /= 9.0f;
+  return shadow;
+}
+
+float calcPointShadow(int light, vec3 position, vec3 normal, vec3 lightDir) {
+  vec4 pointLight = pointLights[light];
+  vec2 texelSize = 1.0f / vec2(textureSize(pointShadowMap, 0));
+
+  // Faces of a light share their size.
+  float tileSize = pointShadowTiles[light * 6].z;
+  if (tileSize == 0.0f) {
+    return 0.0f;
+  }
+
+  // Same normal offset and bias as the cascades, in texels of the face which
+  // grow with the distance to the light.
+  vec3 toFragment = position - pointLight.xyz;
+  vec3 axes = abs(toFragment);
+  float majorAxis = max(axes.x, max(axes.y, axes.z));
+  float worldTexel = 2.0f * majorAxis * texelSize.x / tileSize;
+  float cosTheta = clamp(dot(normal, lightDir), 0.0f, 1.0f);
+  float sinTheta = sqrt(1.0f - cosTheta * cosTheta);
+  toFragment += normal * (NORMAL_OFFSET * worldTexel * sinTheta);
+
+  // Pick the face the direction points through, like a cube map lookup.
+  axes = abs(toFragment);
+  int face;
+  if (axes.x >= axes.y && axes.x >= axes.z) {
+    face = toFragment.x > 0.0f ? 0 : 1;
+    majorAxis = axes.x;
+  } else if (axes.y >= axes.z) {
+    face = toFragment.y > 0.0f ? 2 : 3;
+    majorAxis = axes.y;
+  } else {
+    face = toFragment.z > 0.0f ? 4 : 5;
+    majorAxis = axes.z;
+  }
+  vec2 uv = 0.5f + 0.5f * vec2(dot(faceRights[face], toFragment),
+    dot(faceUps[face], toFragment)) / majorAxis;
+
+  float currentDepth = length(toFragment) / pointLight.w;
+  if (currentDepth > 1.0f) {
+    return 0.0f;
+  }
+  float bias = DEPTH_BIAS * worldTexel / pointLight.w;
 
-  float bias = max(0.05 * (1.0 - dot(normal, lightDir)), 0.005);
+  // Keep the filter on the tile of the face, the neighbouring tiles hold
+  // other faces and lights.
+  vec3 tile = pointShadowTiles[light * 6 + face];
+  uv = tile.xy + uv * tile.z;
+  vec2 minUv = tile.xy + 0.5f * texelSize;
+  vec2 maxUv = tile.xy + tile.z - 0.5f * texelSize;
 
-  float shadow = 0.0;
-  vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
-  for(int x = -1; x <= 1; ++x) {
-    for(int y = -1; y <= 1; ++y) {
-      float pcfDepth = texture(shadowMap, projCoords.xy + vec2(x, y) * texelSize).r;
-      shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;
+  float shadow = 0.0f;
+  for (int x = -1; x <= 1; ++x) {
+    for (int y = -1; y <= 1; ++y) {
+      vec2 offsetUv = clamp(uv + vec2(x, y) * texelSize, minUv, maxUv);
+      float pcfDepth = texture(pointShadowMap, offsetUv).r;
+      shadow += currentDepth - bias > pcfDepth ? 1.0f : 0.0f;
     }
   }
-  shadow /= 9.0;
+  shadow /= 9.0f;
   return shadow;
 }
 
+vec3 calcPointLight(int light, vec3 normal, vec3 viewDir) {
+  vec4 pointLight = pointLights[light];
+  vec3 toLight = pointLight.xyz - frag_in.position;
+  float lightDistance = length(toLight);
+  if (lightDistance >= pointLight.w) {
+    return vec3(0.0f);
+  }
+  vec3 lightDir = toLight / lightDistance;
+
+  // Inverse square falloff, windowed to reach zero at the radius.
+  float ratio = lightDistance / pointLight.w;
+  float window = clamp(1.0f - ratio * ratio * ratio * ratio, 0.0f, 1.0f);
+  float attenuation = window * window / (1.0f + lightDistance * lightDistance);
+
+  float diff = max(dot(lightDir, normal), 0.0f);
+  vec3 halfwayDir = normalize(lightDir + viewDir);
+  float spec = pow(max(dot(normal, halfwayDir), 0.0f), 64.0f);
+
+  float shadow = calcPointShadow(light, frag_in.position, normal, lightDir);
+  return (1.0f - shadow) * attenuation * (diff + spec) * pointLightColor;
+}
+
 void main() {
   vec3 sample = texture(diffuseTexture, frag_in.uv).rgb;
   vec3 normal = normalize(frag_in.normal);
@@ -53,7 +239,7 @@ void main() {
   vec3 ambient = 0.15 * sample;
 
   // Diffuse
-  vec3 lightDir = normalize(lightPos - frag_in.position);
+  vec3 lightDir = normalize(-lightDirection);
   float diff = max(dot(lightDir, normal), 0.0);
   vec3 diffuse = diff * lightColor;
 
@@ -65,8 +251,14 @@ void main() {
   vec3 specular = spec * lightColor;
 
   // Calculate shadow
-  float shadow = calcShadow(frag_in.lightSpacePos, normal, lightDir);
+  float shadow = calcShadow(frag_in.position, frag_in.viewDepth, normal,
+    lightDir);
   vec3 lighting = (ambient + (1.0 - shadow) * (diffuse + specular)) * sample;
 
+  // Point lights, each with its own shadows.
+  for (int i = 0; i < pointLightCount; i++) {
+    lighting += calcPointLight(i, normal, viewDir) * sample;
+  }
+
   color = vec4(lighting, 1.0f);
 }
@@ -0,0 +1,20 @@
+#version 330 core
+
+out float exponential;
+
+uniform sampler2D source; // Horizontally blurred exponential depth.
+uniform ivec3 tile; // Corner and size of the cascade in the atlas.
+
+// Same weights as glsl/shadow_exp_frag.glsl.
+const float weights[5] = float[5](
+  1.0f / 16.0f, 4.0f / 16.0f, 6.0f / 16.0f, 4.0f / 16.0f, 1.0f / 16.0f);
+
+void main() {
+  // Vertical pass from the corner of the intermediate texture into the tile.
+  ivec2 texel = ivec2(gl_FragCoord.xy) - tile.xy;
+  exponential = 0.0f;
+  for (int i = 0; i < 5; i++) {
+    int y = clamp(texel.y + i - 2, 0, tile.z - 1);
+    exponential += weights[i] * texelFetch(source, ivec2(texel.x, y), 0).r;
+  }
+}
@@ -0,0 +1,27 @@
+#version 330 core
+
+// Sharpness of the exponential shadow maps, has to match glsl/fragment.glsl.
+#define ESM_EXPONENT 80.0f
+
+out float exponential;
+
+uniform sampler2D depthMap;
+uniform ivec3 tile; // Corner and size of the cascade in the atlas.
+
+// Binomial weights of the 5 taps, the vertical pass in
+// glsl/shadow_blur_frag.glsl uses the same ones.
+const float weights[5] = float[5](
+  1.0f / 16.0f, 4.0f / 16.0f, 6.0f / 16.0f, 4.0f / 16.0f, 1.0f / 16.0f);
+
+void main() {
+  // Horizontal pass into the corner of the intermediate texture. Exponential
+  // depth can be filtered like color, unlike depth itself, so it is converted
+  // before blurring.
+  ivec2 texel = ivec2(gl_FragCoord.xy);
+  exponential = 0.0f;
+  for (int i = 0; i < 5; i++) {
+    int x = clamp(texel.x + i - 2, 0, tile.z - 1);
+    float depth = texelFetch(depthMap, tile.xy + ivec2(x, texel.y), 0).r;
+    exponential += weights[i] * exp(ESM_EXPONENT * depth);
+  }
+}
@@ -0,0 +1,43 @@
+#ifndef GPUTIMER_H
+#define GPUTIMER_H
+
+extern "C" {
+#include <GL/glew.h>
+}
+
+// Measures how long the GPU spends on the commands issued between begin and
+// end with GL_TIME_ELAPSED queries. Results are read back a few frames late
+// from a ring of queries so that timing never stalls the pipeline. Only one
+// timer can be running at a time, GL does not nest elapsed time queries.
+class GpuTimer {
+  public:
+    GpuTimer();
+    ~GpuTimer();
+
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    void begin();
+    void end();
+
+    // Average of the measurements that finished since the last reset, in
+    // milliseconds. Zero while none have.
+    double milliseconds();
+    GLuint samples();
+    void reset();
+  private:
+    static const GLuint kQueryCount = 4;
+
+    GLuint queries[kQueryCount];
+    GLuint first;   // Oldest query still waiting for its result.
+    GLuint pending; // Queries issued whose result was not read yet.
+
+    GLuint64 total;
+    GLuint count;
+
+    // Reads the results that are ready, or waits for the oldest when wait is
+    // set.
+    void collect(bool wait);
+};
+
+#endif
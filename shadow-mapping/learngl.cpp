@@ -1,10 +1,12 @@
 #define UNUSED(expr) (void)(expr)
 
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <math.h>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -16,8 +18,12 @@ extern "C" {
 #include <SOIL/SOIL.h>
 }
 
+#include "gputimer.h"
 #include "shader.h"
 #include "perspectivecamera.h"
+#include "mipmap.h"
+#include "pointshadows.h"
+#include "shadowcascades.h"
 
 // Window constants for the initial window size.
 const GLuint kWindowWidth = 800;
@@ -26,9 +32,64 @@ const GLuint kWindowHeight = 600;
 // Number of default samples to use with MSAA.
 const GLuint kMSAASamples = 2;
 
-// Shadow depth map size.
-const GLuint kShadowWidth = 1024;
-const GLuint kShadowHeight = 1024;
+// Resolve the multisampled frame in the post-processing shader rather than
+// blitting it into an intermediate texture first, which saves writing and then
+// reading back a full screen texture every frame.
+const bool kFusedResolve = true;
+
+// Filter used when generating texture mipmaps on the CPU.
+const MipFilter kMipFilter = MipFilter::Box;
+
+// Compare the CPU generated mipmaps against glGenerateMipmap when uploading
+// textures (timings and per level error are dumped to stdout).
+const bool kBenchmarkMipmaps = false;
+
+// Shadow map size of every cascade, nearest first. The far cascades cover
+// more of the scene at a lower detail and can get away with fewer texels.
+const std::vector<GLuint> kShadowCascadeResolutions = { 2048, 1024, 1024, 512 };
+
+// Distance from the camera shadows are drawn up to, and the blend between
+// logarithmic (1) and uniform (0) cascade splits.
+const GLfloat kShadowDistance = 40.0f;
+const GLfloat kShadowSplitLambda = 0.75f;
+
+// Draws the scene for a while with every shadow filter and dumps the GPU time
+// spent on the shadow maps and on shading to stdout. The cascades are
+// rendered again every frame so the cost of prefiltering shows up too.
+const bool kBenchmarkShadowFilters = false;
+const GLuint kBenchmarkWarmupFrames = 10;
+const GLuint kBenchmarkFrames = 110;
+
+// Also leave out shadow casters whose shadow can't reach the part of the
+// camera frustum a cascade covers, not just the ones outside of its light
+// projection.
+const bool kCullShadowReceivers = true;
+
+// Bounding spheres of the meshes for culling shadow casters, a unit container
+// and the 15x15 floor.
+const GLfloat kContainerRadius = 0.87f;
+const GLfloat kFloorRadius = 10.61f;
+
+// Size of the atlas the point light shadows share, and the range of sizes
+// their cube faces get depending on how large the lights are on screen.
+const GLuint kPointShadowAtlasSize = 2048;
+const GLuint kPointShadowMinResolution = 64;
+const GLuint kPointShadowMaxResolution = 512;
+
+// Point lights whose shadows are rendered per frame at most, the others
+// keep their shadows from earlier frames until it is their turn.
+const GLuint kPointShadowUpdateBudget = 2;
+
+// How far the point lights reach.
+const GLfloat kPointLightRadius = 6.0f;
+const glm::vec3 kPointLightColor(1.2f, 1.0f, 0.8f);
+
+// The directional light shines along this direction (before orbiting).
+const glm::vec3 kLightDirection(2.0f, -4.0f, 1.0f);
+
+// Container that bobs up and down when moving containers is toggled on. It is
+// drawn into the shadow maps every frame while the rest stays cached.
+const GLuint kDynamicContainer = 7;
 
 // Positions all containers
 const glm::vec3 cubePositions[] = {
@@ -79,17 +140,48 @@ bool firstMouseEvent = true;
 // Keyboard state.
 bool keys[1024];
 
+// Light and container animation, toggled with L and M. The shadow maps only
+// render the static containers again when the light moves or the set of
+// static containers changes.
+glm::vec3 lightDirection = kLightDirection;
+GLfloat lightAngle = 0.0f;
+GLfloat containerTime = 0.0f;
+bool orbitLight = false;
+bool moveContainer = false;
+bool castersChanged = false;
+
+// Filter of the directional light shadows, cycled through with F.
+ShadowFilter shadowFilter = ShadowFilter::PCF;
+
+// Which containers to draw, the dynamic ones are the animated ones.
+enum class Casters {
+  All,
+  Static,
+  Dynamic
+};
+
 // Global shaders (compiled later).
-Shader shader, depthShader, postShader;
+Shader shader, depthShader, cubeDepthShader, postShader;
 
 // Global textures (loaded later).
 GLuint containerTexture, containerSpecular, containerEmission;
 
 void setupMatrices();
-void drawContainers(GLuint VAO, Shader shader, bool shadowMap, GLuint map);
+void drawContainers(GLuint VAO, Shader shader, bool shadowMap,
+    Casters casters, const ShadowCascades* cascades = nullptr,
+    GLuint cascade = 0);
+glm::mat4 containerModel(GLuint i);
+bool isDynamic(GLuint i);
+const char* shadowFilterName(ShadowFilter filter);
+void drawPointShadowCasters(GLuint VAO, Shader shader,
+    const PointShadows& pointShadows);
+
+// Sets up the scene and renders it until the window is closed, returns the
+// exit status.
+int run(GLFWwindow* window, int fbWidth, int fbHeight);
 
 // Utility functions.
-GLuint loadTexture(std::string filepath);
+GLuint loadTexture(const MipChain& chain);
 void move(GLfloat delta);
 GLfloat easeOutQuart(GLfloat t, GLfloat b, GLfloat c, GLfloat d);
 
@@ -151,15 +243,33 @@ int main() {
   // prevent overlapping polygon artifacts.
   glEnable(GL_DEPTH_TEST);
 
+  // Everything owning GL objects lives in run so it gets deleted before the
+  // context goes away with glfwTerminate.
+  int status = run(window, fbWidth, fbHeight);
+
+  // Terminate GLFW and clean any resources before exiting.
+  glfwTerminate();
+
+  return status;
+}
+
+int run(GLFWwindow* window, int fbWidth, int fbHeight) {
   // Read and compile the vertex and fragment shaders using
   // the shader helper class.
   shader = Shader("glsl/vertex.glsl", "glsl/fragment.glsl", "glsl/geometry.glsl");
   depthShader = Shader("glsl/depth_vert.glsl", "glsl/depth_frag.glsl");
+  cubeDepthShader = Shader("glsl/cube_depth_vert.glsl",
+      "glsl/cube_depth_frag.glsl", "glsl/cube_depth_geo.glsl");
   postShader = Shader("glsl/post_vert.glsl", "glsl/post_frag.glsl");
 
-  containerTexture  = loadTexture("assets/container2.png");
-  containerSpecular = loadTexture("assets/container2_specular.png");
-  containerEmission = loadTexture("assets/matrix.jpg");
+  // Decode the textures and generate their mipmaps on worker threads while
+  // the rest of the scene is set up. They are uploaded before rendering.
+  std::future<MipChain> containerTextureChain = loadMipChainAsync(
+      "assets/container2.png", 3, true, kMipFilter);
+  std::future<MipChain> containerSpecularChain = loadMipChainAsync(
+      "assets/container2_specular.png", 3, true, kMipFilter);
+  std::future<MipChain> containerEmissionChain = loadMipChainAsync(
+      "assets/matrix.jpg", 3, true, kMipFilter);
 
   // Container mesh data.
   GLfloat vertices[] = {
@@ -227,6 +337,12 @@ int main() {
   glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, frameColorBufferMultiSampled);
   glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, kMSAASamples, GL_RGB,
       fbWidth, fbHeight, GL_TRUE);
+
+  // The implementation may hand out more samples than asked for, the fused
+  // resolve has to go over all of them.
+  GLint frameSamples;
+  glGetTexLevelParameteriv(GL_TEXTURE_2D_MULTISAMPLE, 0, GL_TEXTURE_SAMPLES,
+      &frameSamples);
   glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
 
   // Attach the texture to the framebuffer.
@@ -250,67 +366,66 @@ int main() {
   // never happen if we attached the texture but it's good practice to check.
   if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
     std::cerr << "ERROR: Framebuffer is not complete!" << std::endl;
-    glfwTerminate();
     return 1;
   }
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-  // Generate texture for intermediate stage.
-  GLuint screenTexture;
-  glGenTextures(1, &screenTexture);
-  glBindTexture(GL_TEXTURE_2D, screenTexture);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, fbWidth, fbHeight, 0, GL_RGB,
-      GL_UNSIGNED_BYTE, nullptr);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glBindTexture(GL_TEXTURE_2D, 0);
-
-  // Second framebuffer for post.
-  GLuint intermediateFBO;
-  glGenFramebuffers(1, &intermediateFBO);
-  glBindFramebuffer(GL_FRAMEBUFFER, intermediateFBO);
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
-      screenTexture, 0);
+  // Generate texture for intermediate stage, only needed when the frame is
+  // blitted before post-processing.
+  GLuint screenTexture = 0;
+  GLuint intermediateFBO = 0;
+  if (!kFusedResolve) {
+    glGenTextures(1, &screenTexture);
+    glBindTexture(GL_TEXTURE_2D, screenTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, fbWidth, fbHeight, 0, GL_RGB,
+        GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // Second framebuffer for post.
+    glGenFramebuffers(1, &intermediateFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, intermediateFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+        GL_TEXTURE_2D, screenTexture, 0);
+
+    // Panic if the framebuffer is somehow incomplete at this stage. This
+    // should never happen if we attached the texture but it's good practice
+    // to check.
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+      std::cerr << "ERROR: Framebuffer is not complete!" << std::endl;
+      return 1;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  }
 
-  // Panic if the framebuffer is somehow incomplete at this stage. This should
-  // never happen if we attached the texture but it's good practice to check.
-  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-    std::cerr << "ERROR: Framebuffer is not complete!" << std::endl;
-    glfwTerminate();
+  // Cascaded shadow maps for the directional light.
+  ShadowCascades shadowCascades(kShadowCascadeResolutions, kShadowDistance,
+      kShadowSplitLambda);
+  shadowCascades.setReceiverCulling(kCullShadowReceivers);
+  if (!shadowCascades.complete()) {
+    std::cerr << "ERROR: Shadow map framebuffer is not complete!" << std::endl;
     return 1;
   }
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-  // Create a texture to hold the depth map data.
-  // The depth map is used for shadow mapping.
-  GLuint depthMap;
-  glGenTextures(1, &depthMap);
-  glBindTexture(GL_TEXTURE_2D, depthMap);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, kShadowWidth,
-      kShadowHeight, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-  GLfloat borderColor[] = { 1.0, 1.0, 1.0, 1.0 };
-  glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-  glBindTexture(GL_TEXTURE_2D, 0);
-
-  GLuint depthMapFBO;
-  glGenFramebuffers(1, &depthMapFBO);
-  glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
-  glDrawBuffer(GL_NONE);
-  glReadBuffer(GL_NONE);
-
-  // Panic if the framebuffer is somehow incomplete at this stage. This should
-  // never happen if we attached the texture but it's good practice to check.
-  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-    std::cerr << "ERROR: Framebuffer is not complete!" << std::endl;
-    glfwTerminate();
+  std::cout << "Shadow cascades: " << shadowCascades.count() << " ("
+    << shadowCascades.bytes() / 1024 << " KiB)" << std::endl;
+
+  // Cube shadows for the point lights, sharing one atlas.
+  const GLuint pointLightCount = sizeof(pointLightPositions) /
+    sizeof(pointLightPositions[0]);
+  PointShadows pointShadows(kPointShadowAtlasSize, kPointShadowMinResolution,
+      kPointShadowMaxResolution, kPointShadowUpdateBudget);
+  if (!pointShadows.complete()) {
+    std::cerr << "ERROR: Point shadows can't be rendered!" << std::endl;
     return 1;
   }
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  std::cout << "Point shadows: " << pointLightCount << " ("
+    << pointShadows.bytes() / 1024 << " KiB)" << std::endl;
+  std::vector<glm::vec4> pointLights;
+  for (GLuint i = 0; i < pointLightCount; i++) {
+    pointLights.push_back(glm::vec4(pointLightPositions[i],
+          kPointLightRadius));
+  }
 
   // Create a VBO to store the vertex data, an EBO to store indice data, and
   // create a VAO to retain our vertex attribute pointers.
@@ -330,6 +445,26 @@ int main() {
   glEnableVertexAttribArray(2);
   glBindVertexArray(0);
 
+  // Depth only passes (the shadow maps) just need the positions. A tightly
+  // packed copy of them fetches 12 bytes per vertex instead of 32.
+  const GLuint vertexCount = sizeof(vertices) / (8 * sizeof(GLfloat));
+  std::vector<GLfloat> positions;
+  for (GLuint i = 0; i < vertexCount; i++) {
+    positions.insert(positions.end(), vertices + i * 8, vertices + i * 8 + 3);
+  }
+  GLuint depthVBO, depthVAO;
+  glGenVertexArrays(1, &depthVAO);
+  glGenBuffers(1, &depthVBO);
+
+  glBindVertexArray(depthVAO);
+  glBindBuffer(GL_ARRAY_BUFFER, depthVBO);
+  glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(GLfloat),
+      &positions[0], GL_STATIC_DRAW);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat),
+      (GLvoid*)0);
+  glEnableVertexAttribArray(0);
+  glBindVertexArray(0);
+
   // Create a lamp box thing using the existing container VBO.
   GLuint lightVAO;
   glGenVertexArrays(1, &lightVAO);
@@ -387,6 +522,11 @@ int main() {
   glEnableVertexAttribArray(1);
   glBindVertexArray(0);
 
+  // Upload the textures once their mip chains are ready.
+  containerTexture  = loadTexture(containerTextureChain.get());
+  containerSpecular = loadTexture(containerSpecularChain.get());
+  containerEmission = loadTexture(containerEmissionChain.get());
+
   // Create a perspective camera to fit the viewport.
   screenWidth = (GLfloat)fbWidth;
   screenHeight = (GLfloat)fbHeight;
@@ -402,28 +542,127 @@ int main() {
   GLfloat delta = 0.0f;
   GLfloat lastFrame = 0.0f;
 
+  // The benchmark starts from the first filter.
+  GLuint benchmarkFrame = 0;
+  if (kBenchmarkShadowFilters) {
+    shadowFilter = ShadowFilter::PCF;
+    std::cout << "filter        shadows (GPU)  shading (GPU)" << std::endl;
+  }
+
+  // Time the shadow passes and the lit scene on the GPU, shown in the window
+  // title every second.
+  GpuTimer shadowTimer;
+  GpuTimer shadingTimer;
+  GLfloat lastReport = 0.0f;
+
   // Render loop.
   while (!glfwWindowShouldClose(window)) {
     GLfloat currentFrame = glfwGetTime();
     delta = currentFrame - lastFrame;
     lastFrame = currentFrame;
 
+    // Move the filter benchmark along. Measuring only starts a few frames into
+    // each filter so no timings of the previous one are still in flight.
+    if (kBenchmarkShadowFilters) {
+      benchmarkFrame++;
+      if (benchmarkFrame == kBenchmarkWarmupFrames) {
+        shadowTimer.reset();
+        shadingTimer.reset();
+      } else if (benchmarkFrame == kBenchmarkFrames) {
+        std::cout << std::setw(12) << std::left <<
+          shadowFilterName(shadowFilter) << std::right <<
+          std::fixed << std::setprecision(3) <<
+          std::setw(12) << shadowTimer.milliseconds() << " ms" <<
+          std::setw(12) << shadingTimer.milliseconds() << " ms" <<
+          std::endl;
+
+        benchmarkFrame = 0;
+        GLuint next = (GLuint)shadowFilter + 1;
+        if (next == kShadowFilterCount) {
+          glfwSetWindowShouldClose(window, GL_TRUE);
+        }
+        shadowFilter = (ShadowFilter)(next % kShadowFilterCount);
+      }
+      castersChanged = true;
+    }
+
     // Check and call events.
     glfwPollEvents();
     move(delta);
 
-    // Use the depth shader and set the required uniforms. The depth shader uses
-    // a special lightSpaceMatrix with an orthographic projection looking at the
-    // specific mesh to cast a shadow for.
+    // Update the time counter for the camera zoom.
+    const GLfloat limitTime = 1.0f;
+    fovTime += delta;
+    if (fovTime > limitTime) {
+      fovTime = limitTime;
+    }
+
+    // Update the perspective to account for changes in fov.
+    // Used by the scroll to zoom feature.
+    camera.fov = easeOutQuart(fovTime, startFov, (startFov - targetFov) * -1, limitTime);
+    camera.update();
+
+    // Advance the animations.
+    if (orbitLight) {
+      lightAngle += 0.5f * delta;
+      GLfloat c = cos(lightAngle), s = sin(lightAngle);
+      lightDirection = glm::vec3(
+          c * kLightDirection.x + s * kLightDirection.z,
+          kLightDirection.y,
+          c * kLightDirection.z - s * kLightDirection.x);
+    }
+    if (moveContainer) {
+      containerTime += delta;
+    }
+
+    // Fit the cascades around the camera and render the depth of the scene as
+    // seen from the light into each of them. The depth shader uses the
+    // lightSpaceMatrix of the cascade, an orthographic projection bounding its
+    // slice of the camera frustum.
     //
-    // Render to the depth map for shadow mapping.
-    glViewport(0, 0, kShadowWidth, kShadowHeight);
-    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-    glClear(GL_DEPTH_BUFFER_BIT);
+    // The static containers are only drawn into the cascades that are dirty,
+    // with a still camera and light that costs nothing. The animated one is
+    // drawn on top of the cached depth every frame.
+    shadowTimer.begin();
+    shadowCascades.setFilter(shadowFilter);
+    shadowCascades.update(camera, lightDirection);
+    pointShadows.update(pointLights, camera);
+    if (castersChanged || moveContainer) {
+      pointShadows.invalidate();
+    }
+    if (castersChanged) {
+      shadowCascades.invalidate();
+      castersChanged = false;
+    }
     glEnable(GL_DEPTH_TEST);
     depthShader.use();
-    drawContainers(VBO, depthShader, true, 0);
+    for (GLuint i = 0; i < shadowCascades.count(); i++) {
+      if (shadowCascades.beginStatic(i, depthShader)) {
+        drawContainers(depthVAO, depthShader, true, Casters::Static,
+            &shadowCascades, i);
+      }
+    }
+    if (moveContainer) {
+      for (GLuint i = 0; i < shadowCascades.count(); i++) {
+        shadowCascades.beginDynamic(i, depthShader);
+        drawContainers(depthVAO, depthShader, true, Casters::Dynamic,
+            &shadowCascades, i);
+      }
+    }
+
+    // All the faces of the point lights due this frame are rendered in one
+    // pass, again only when something changed.
+    cubeDepthShader.use();
+    if (pointShadows.begin(cubeDepthShader)) {
+      drawPointShadowCasters(depthVAO, cubeDepthShader, pointShadows);
+      pointShadows.end();
+    }
+
+    // Blur the exponential maps of the cascades that changed, when filtering
+    // with them.
+    shadowCascades.prefilter();
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    shadowTimer.end();
 
     // Bind the off screen framebuffer (for post-processing) and clear the
     // screen to a nice blue color.
@@ -433,26 +672,32 @@ int main() {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glEnable(GL_DEPTH_TEST);
 
-    // Update the time counter for the camera zoom.
-    const GLfloat limitTime = 1.0f;
-    fovTime += delta;
-    if (fovTime > limitTime) {
-      fovTime = limitTime;
-    }
-
-    // Update the perspective to account for changes in fov.
-    // Used by the scroll to zoom feature.
-    camera.fov = easeOutQuart(fovTime, startFov, (startFov - targetFov) * -1, limitTime);
-    camera.update();
-
+    shadingTimer.begin();
     shader.use();
     setupMatrices();
-    drawContainers(VBO, shader, false, depthMap);
+    shadowCascades.bind(shader, 1);
+    pointShadows.bind(shader, 4);
+    drawContainers(VAO, shader, false, Casters::All);
+    shadingTimer.end();
+
+    // Show the average time spent on shadows and shading every second.
+    if (!kBenchmarkShadowFilters && currentFrame - lastReport >= 1.0f) {
+      std::ostringstream title;
+      title << "LearnGL (" << shadowFilterName(shadowFilter) <<
+        " shadows " << shadowTimer.milliseconds() << " ms, shading " <<
+        shadingTimer.milliseconds() << " ms)";
+      glfwSetWindowTitle(window, title.str().c_str());
+      shadowTimer.reset();
+      shadingTimer.reset();
+      lastReport = currentFrame;
+    }
 
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, intermediateFBO);
-    glBlitFramebuffer(0, 0, fbWidth, fbHeight, 0, 0, fbWidth, fbHeight,
-        GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    if (!kFusedResolve) {
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+      glBindFramebuffer(GL_DRAW_FRAMEBUFFER, intermediateFBO);
+      glBlitFramebuffer(0, 0, fbWidth, fbHeight, 0, 0, fbWidth, fbHeight,
+          GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    }
 
     // Unbind the offscreen framebuffer containing the unprocessed frame.
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -463,11 +708,18 @@ int main() {
     postShader.use();
     glBindVertexArray(frameVAO);
 
-    // Send the texture sampler to the shader.
+    // Send the texture samplers to the shader. With the fused resolve the
+    // samples of the multisampled frame are read directly, otherwise the
+    // blitted copy is.
     GLuint frameTexture = glGetUniformLocation(postShader.program, "frameTexture");
     glUniform1i(frameTexture, 0);
+    glUniform1i(glGetUniformLocation(postShader.program, "frameSamples"), 1);
+    glUniform1i(glGetUniformLocation(postShader.program, "frameSampleCount"),
+        kFusedResolve ? frameSamples : 0);
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, screenTexture);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, frameColorBufferMultiSampled);
 
     // Render the color buffer in the framebuffer to the quad with post shader.
     glDrawArrays(GL_TRIANGLES, 0, 6);
@@ -481,12 +733,11 @@ int main() {
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
   glDeleteFramebuffers(1, &FBO);
 
-  // Properly deallocate the VBO and VAO.
+  // Properly deallocate the VBOs and VAOs.
   glDeleteVertexArrays(1, &VAO);
   glDeleteBuffers(1, &VBO);
-
-  // Terminate GLFW and clean any resources before exiting.
-  glfwTerminate();
+  glDeleteVertexArrays(1, &depthVAO);
+  glDeleteBuffers(1, &depthVBO);
 
   return 0;
 }
@@ -499,54 +750,44 @@ void setupMatrices() {
   glUniformMatrix4fv(projectionMatrix, 1, GL_FALSE, glm::value_ptr(camera.projection));
 }
 
-void drawContainers(GLuint VAO, Shader shader, bool shadowMap, GLuint map) {
+void drawContainers(GLuint VAO, Shader shader, bool shadowMap,
+    Casters casters, const ShadowCascades* cascades, GLuint cascade) {
   // Bind the VAO and shader.
   glBindVertexArray(VAO);
 
-  glm::vec3 lightPosition = glm::vec3(-2.0f, 4.0f, -1.0f);
-  GLfloat near_plane = 1.0f, far_plane = 7.5f;
-  glm::mat4 lightProjection = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f,
-      near_plane, far_plane);
-  glm::mat4 lightView = glm::lookAt(
-      lightPosition,
-      glm::vec3(0.0f),
-      glm::vec3(1.0f)
-  );
-  glm::mat4 lightSpace = lightProjection * lightView;
-
-  GLuint lightSpaceMatrix = glGetUniformLocation(shader.program, "lightSpaceMatrix");
-  glUniformMatrix4fv(lightSpaceMatrix, 1, GL_FALSE, glm::value_ptr(lightSpace));
-
   if (!shadowMap) {
     // Pass light value.
     GLuint materialDiffuse = glGetUniformLocation(shader.program, "diffuseTexture");
     glUniform1i(materialDiffuse, 0);
 
-    // Pass the shadow map/depth map or whatever. Non consistent names are good.
-    GLuint depthMap = glGetUniformLocation(shader.program, "shadowMap");
-    glUniform1i(depthMap, 1);
-
-    // Bind the textures.
+    // Bind the textures, the shadow cascades are bound to units 1 to 3 and
+    // the point shadows to unit 4.
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, containerTexture);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, map);
 
     // Misc values.
     GLuint viewPos = glGetUniformLocation(shader.program, "viewPos");
     glUniform3f(viewPos, camera.position.x, camera.position.y, camera.position.z);
-    GLuint lightPos = glGetUniformLocation(shader.program, "lightPos");
-    glUniform3f(lightPos, lightPosition.x, lightPosition.y, lightPosition.z);
+    GLuint lightDir = glGetUniformLocation(shader.program, "lightDirection");
+    glUniform3f(lightDir, lightDirection.x, lightDirection.y,
+        lightDirection.z);
+    GLuint pointLightColor = glGetUniformLocation(shader.program,
+        "pointLightColor");
+    glUniform3f(pointLightColor, kPointLightColor.x, kPointLightColor.y,
+        kPointLightColor.z);
 
     // Draw multiple containers!
     GLuint modelMatrix = glGetUniformLocation(shader.program, "model");
     GLuint normalMatrix = glGetUniformLocation(shader.program, "normalMatrix");
 
     for (GLuint i = 0; i < 10; i++) {
+      if ((casters == Casters::Static && isDynamic(i)) ||
+          (casters == Casters::Dynamic && !isDynamic(i))) {
+        continue;
+      }
+
       // Apply world transformations.
-      model = glm::mat4();
-      model = glm::translate(model, cubePositions[i]);
-      model = glm::rotate(model, i * 20.0f, glm::vec3(1.0f, 0.3f, 0.5f));
+      model = containerModel(i);
       glUniformMatrix4fv(modelMatrix, 1, GL_FALSE, glm::value_ptr(model));
 
       // Calculate the normal matrix on the CPU (keep them normals perpendicular).
@@ -558,22 +799,32 @@ void drawContainers(GLuint VAO, Shader shader, bool shadowMap, GLuint map) {
     }
 
     // Draw a scaled container under the camera to act as a floor.
-    model = glm::mat4();
-    model = glm::translate(model, glm::vec3(0.0f, -1.0f, 0.0f));
-    model = glm::scale(model, glm::vec3(15.0f, 0.001f, 15.0f));
-    glUniformMatrix4fv(modelMatrix, 1, GL_FALSE, glm::value_ptr(model));
-    normal = glm::mat3(glm::transpose(glm::inverse(model)));
-    glUniformMatrix3fv(normalMatrix, 1, GL_FALSE, glm::value_ptr(normal));
-    glDrawArrays(GL_TRIANGLES, 0, 36);
+    if (casters != Casters::Dynamic) {
+      model = glm::mat4();
+      model = glm::translate(model, glm::vec3(0.0f, -1.0f, 0.0f));
+      model = glm::scale(model, glm::vec3(15.0f, 0.001f, 15.0f));
+      glUniformMatrix4fv(modelMatrix, 1, GL_FALSE, glm::value_ptr(model));
+      normal = glm::mat3(glm::transpose(glm::inverse(model)));
+      glUniformMatrix3fv(normalMatrix, 1, GL_FALSE, glm::value_ptr(normal));
+      glDrawArrays(GL_TRIANGLES, 0, 36);
+    }
   } else {
     // Draw multiple containers!
     GLuint modelMatrix = glGetUniformLocation(shader.program, "model");
 
     for (GLuint i = 0; i < 10; i++) {
-      // Apply world transformations.
-      model = glm::mat4();
-      model = glm::translate(model, cubePositions[i]);
-      model = glm::rotate(model, i * 20.0f, glm::vec3(1.0f, 0.3f, 0.5f));
+      if ((casters == Casters::Static && isDynamic(i)) ||
+          (casters == Casters::Dynamic && !isDynamic(i))) {
+        continue;
+      }
+
+      // Apply world transformations. Containers that can't cast a visible
+      // shadow into the cascade are skipped.
+      model = containerModel(i);
+      if (cascades != nullptr && !cascades->castsShadow(cascade,
+            glm::vec3(model[3]), kContainerRadius)) {
+        continue;
+      }
       glUniformMatrix4fv(modelMatrix, 1, GL_FALSE, glm::value_ptr(model));
 
       // Draw the container.
@@ -581,18 +832,83 @@ void drawContainers(GLuint VAO, Shader shader, bool shadowMap, GLuint map) {
     }
 
     // Draw a scaled container under the camera to act as a floor.
+    if (casters != Casters::Dynamic && (cascades == nullptr ||
+          cascades->castsShadow(cascade, glm::vec3(0.0f, -1.0f, 0.0f),
+            kFloorRadius))) {
+      model = glm::mat4();
+      model = glm::translate(model, glm::vec3(0.0f, -1.0f, 0.0f));
+      model = glm::scale(model, glm::vec3(15.0f, 0.001f, 15.0f));
+      glUniformMatrix4fv(modelMatrix, 1, GL_FALSE, glm::value_ptr(model));
+      glDrawArrays(GL_TRIANGLES, 0, 36);
+    }
+  }
+
+  // We're done drawing containers.
+  glBindVertexArray(0);
+}
+
+glm::mat4 containerModel(GLuint i) {
+  glm::mat4 model;
+  model = glm::translate(model, cubePositions[i]);
+  if (isDynamic(i)) {
+    model = glm::translate(model, glm::vec3(0.0f, sin(containerTime), 0.0f));
+  }
+  model = glm::rotate(model, i * 20.0f, glm::vec3(1.0f, 0.3f, 0.5f));
+  return model;
+}
+
+bool isDynamic(GLuint i) {
+  return moveContainer && i == kDynamicContainer;
+}
+
+const char* shadowFilterName(ShadowFilter filter) {
+  switch (filter) {
+    case ShadowFilter::PCF:
+      return "pcf";
+    case ShadowFilter::HardwarePCF:
+      return "hardware";
+    case ShadowFilter::Exponential:
+      return "exponential";
+  }
+  return "";
+}
+
+void drawPointShadowCasters(GLuint VAO, Shader shader,
+    const PointShadows& pointShadows) {
+  glBindVertexArray(VAO);
+
+  GLuint modelMatrix = glGetUniformLocation(shader.program, "model");
+  GLuint faceMask = glGetUniformLocation(shader.program, "faceMask");
+
+  // Every container is only copied into the cube faces it overlaps, most
+  // only reach one or two faces of a single light.
+  for (GLuint i = 0; i < 10; i++) {
+    model = containerModel(i);
+    GLuint mask = pointShadows.faceMask(glm::vec3(model[3]), kContainerRadius);
+    if (mask == 0) {
+      continue;
+    }
+    glUniform1i(faceMask, mask);
+    glUniformMatrix4fv(modelMatrix, 1, GL_FALSE, glm::value_ptr(model));
+    glDrawArrays(GL_TRIANGLES, 0, 36);
+  }
+
+  // The floor.
+  GLuint mask = pointShadows.faceMask(glm::vec3(0.0f, -1.0f, 0.0f),
+      kFloorRadius);
+  if (mask != 0) {
     model = glm::mat4();
     model = glm::translate(model, glm::vec3(0.0f, -1.0f, 0.0f));
     model = glm::scale(model, glm::vec3(15.0f, 0.001f, 15.0f));
+    glUniform1i(faceMask, mask);
     glUniformMatrix4fv(modelMatrix, 1, GL_FALSE, glm::value_ptr(model));
     glDrawArrays(GL_TRIANGLES, 0, 36);
   }
 
-  // We're done drawing containers.
   glBindVertexArray(0);
 }
 
-GLuint loadTexture(std::string filepath) {
+GLuint loadTexture(const MipChain& chain) {
   // Generate the texture on the OpenGL side and bind it.
   GLuint texture;
   glGenTextures(1, &texture);
@@ -603,17 +919,15 @@ GLuint loadTexture(std::string filepath) {
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-  // Load in the container texture using the soil library.
-  int width, height;
-  unsigned char* image = SOIL_load_image(filepath.c_str(), &width, &height, 0, SOIL_LOAD_RGB);
+  // Upload every level of the mip chain. The levels were filtered in linear
+  // space on the CPU so they don't rely on the driver handling sRGB properly.
+  uploadMipChain(GL_TEXTURE_2D, chain);
 
-  // Load the image data to the currently bound texture. Also create some
-  // mipmaps for it for perf.
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-  glGenerateMipmap(GL_TEXTURE_2D);
+  if (kBenchmarkMipmaps) {
+    benchmarkMipChain(chain, kMipFilter);
+  }
 
-  // Free the image and unbind the texture.
-  SOIL_free_image_data(image);
+  // Unbind the texture.
   glBindTexture(GL_TEXTURE_2D, 0);
 
   return texture;
@@ -650,6 +964,23 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mode
   if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
     glfwSetWindowShouldClose(window, GL_TRUE);
   }
+
+  // Toggle orbiting the light around the scene.
+  if (key == GLFW_KEY_L && action == GLFW_PRESS) {
+    orbitLight = !orbitLight;
+  }
+
+  // Toggle moving a container. It leaves or joins the cached static casters.
+  if (key == GLFW_KEY_M && action == GLFW_PRESS) {
+    moveContainer = !moveContainer;
+    castersChanged = true;
+  }
+
+  // Cycle through the shadow filters.
+  if (key == GLFW_KEY_F && action == GLFW_PRESS) {
+    shadowFilter = (ShadowFilter)(((GLuint)shadowFilter + 1) %
+        kShadowFilterCount);
+  }
 }
 
 void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
@@ -0,0 +1,55 @@
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include <future>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <GL/glew.h>
+}
+
+// Filters available for downsampling one mip level into the next. Box is a
+// plain 2x2 average, Kaiser is a wider windowed sinc that keeps distant mips
+// sharper at the cost of a few more taps.
+enum class MipFilter {
+  Box,
+  Kaiser
+};
+
+// A single level of a mip chain stored as tightly packed 8-bit texels.
+struct MipLevel {
+  GLsizei width;
+  GLsizei height;
+  std::vector<GLubyte> data;
+};
+
+// Every level of a texture from the full size image down to 1x1.
+struct MipChain {
+  GLuint channels;
+  bool srgb;
+  std::vector<MipLevel> levels;
+};
+
+// Builds the full mip chain for an 8-bit image on the CPU. Color channels of
+// sRGB images are converted to linear space before filtering so the smaller
+// levels do not darken, alpha is always filtered as is. Rows of each level are
+// split between the given number of threads (0 uses every core).
+MipChain generateMipChain(const GLubyte* image, GLsizei width, GLsizei height,
+    GLuint channels, bool srgb, MipFilter filter = MipFilter::Box,
+    GLuint threads = 0);
+
+// Decodes an image with SOIL and generates its mip chain on a worker thread so
+// the GL thread only has to upload the result.
+std::future<MipChain> loadMipChainAsync(const std::string& filepath,
+    GLuint channels, bool srgb, MipFilter filter = MipFilter::Box);
+
+// Uploads every level of the chain to the texture currently bound to target.
+void uploadMipChain(GLenum target, const MipChain& chain);
+
+// Times the CPU path against glTexImage2D + glGenerateMipmap for the base level
+// of the chain and compares the driver's levels with ours, dumping the timings
+// and the per level error to stdout.
+void benchmarkMipChain(const MipChain& chain, MipFilter filter);
+
+#endif
@@ -0,0 +1,356 @@
+#include "pointshadows.h"
+
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <string>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+namespace {
+
+// Direction and up vector of every cube face, in the usual cube map order and
+// orientation (+X, -X, +Y, -Y, +Z, -Z). glsl/fragment.glsl has the matching
+// right and up vectors to find the texel of a direction.
+const glm::vec3 kFaceDirections[6] = {
+  glm::vec3( 1.0f,  0.0f,  0.0f), glm::vec3(-1.0f,  0.0f,  0.0f),
+  glm::vec3( 0.0f,  1.0f,  0.0f), glm::vec3( 0.0f, -1.0f,  0.0f),
+  glm::vec3( 0.0f,  0.0f,  1.0f), glm::vec3( 0.0f,  0.0f, -1.0f)
+};
+const glm::vec3 kFaceUps[6] = {
+  glm::vec3( 0.0f, -1.0f,  0.0f), glm::vec3( 0.0f, -1.0f,  0.0f),
+  glm::vec3( 0.0f,  0.0f,  1.0f), glm::vec3( 0.0f,  0.0f, -1.0f),
+  glm::vec3( 0.0f, -1.0f,  0.0f), glm::vec3( 0.0f, -1.0f,  0.0f)
+};
+
+// Near plane of the faces, casters closer to the light than this are clipped.
+const GLfloat kFaceNear = 0.05f;
+
+// Components glsl/cube_depth_geo.glsl writes per vertex: the position, four
+// clip distances, the world position and the light index. GL 3.3 guarantees
+// room for 1024 per invocation, which has to hold every face of a pass.
+const GLuint kFaceVertexComponents = 4 + 4 + 3 + 1;
+const GLuint kPassVertices = 3 * 6 * kMaxPointShadows;
+static_assert(kPassVertices * kFaceVertexComponents <= 1024,
+    "Point shadow passes exceed the geometry shader output guaranteed by GL");
+
+// Importance of lights that reach nothing on screen. They still get their
+// turn, just rarely.
+const GLfloat kMinImportance = 0.01f;
+
+// Radius of the light on screen over half the screen height, or the minimum
+// importance when it is outside of the view frustum.
+GLfloat screenImportance(const PerspectiveCamera& camera, glm::vec4 light) {
+  glm::vec3 center(camera.view * glm::vec4(glm::vec3(light), 1.0f));
+  GLfloat radius = light.w;
+  GLfloat distance = glm::length(center);
+  if (distance <= radius) {
+    return 1.0f;
+  }
+
+  GLfloat depth = -center.z;
+  GLfloat tanY = tanf(camera.fov * 0.5f);
+  GLfloat tanX = tanY * camera.aspect;
+  if (depth < -radius ||
+      (fabsf(center.x) - depth * tanX) / sqrtf(1.0f + tanX * tanX) > radius ||
+      (fabsf(center.y) - depth * tanY) / sqrtf(1.0f + tanY * tanY) > radius) {
+    return kMinImportance;
+  }
+
+  return glm::clamp(radius / (distance * tanY), kMinImportance, 1.0f);
+}
+
+}
+
+PointShadows::PointShadows(GLuint atlasSize, GLuint minResolution,
+    GLuint maxResolution, GLuint updateBudget) :
+    atlas(atlasSize, minResolution), maxResolution(maxResolution),
+    updateBudget(std::min(updateBudget, kMaxPointShadows)),
+    overflowReported(false) {
+}
+
+bool PointShadows::complete() {
+  // Drivers may allow more than GL guarantees but not less.
+  GLint maxVertices, maxComponents;
+  glGetIntegerv(GL_MAX_GEOMETRY_OUTPUT_VERTICES, &maxVertices);
+  glGetIntegerv(GL_MAX_GEOMETRY_TOTAL_OUTPUT_COMPONENTS, &maxComponents);
+  if ((GLint)kPassVertices > maxVertices ||
+      (GLint)(kPassVertices * kFaceVertexComponents) > maxComponents) {
+    std::cerr << "ERROR: Point shadows need " << kPassVertices <<
+      " geometry shader output vertices of " << kFaceVertexComponents <<
+      " components, the driver allows " << maxVertices << " vertices and " <<
+      maxComponents << " components" << std::endl;
+    return false;
+  }
+
+  return this->atlas.complete();
+}
+
+void PointShadows::update(const std::vector<glm::vec4>& lights,
+    const PerspectiveCamera& camera) {
+  GLuint count = std::min((GLuint)lights.size(), kMaxPointLights);
+  if (count != this->lights.size()) {
+    this->lights.assign(lights.begin(), lights.begin() + count);
+    this->importances.assign(count, 0.0f);
+    this->resolutions.assign(count, 0);
+    this->dirty.assign(count, true);
+    this->rendered.assign(count, false);
+    this->waits.assign(count, 0);
+  }
+
+  for (GLuint i = 0; i < count; i++) {
+    if (lights[i] != this->lights[i]) {
+      this->dirty[i] = true;
+    }
+    this->lights[i] = lights[i];
+    this->importances[i] = screenImportance(camera, lights[i]);
+  }
+
+  resize();
+}
+
+void PointShadows::resize() {
+  // The largest power of two faces the importance asks for. They only shrink
+  // once they are two sizes too large, so lights near a boundary don't keep
+  // moving their tiles around.
+  GLuint minResolution = this->atlas.minTileSize();
+  std::vector<GLuint> resolutions(this->lights.size());
+  for (GLuint i = 0; i < this->lights.size(); i++) {
+    GLuint resolution = minResolution;
+    while (resolution * 2 <= this->maxResolution &&
+        resolution * 2 <= this->importances[i] * this->maxResolution) {
+      resolution *= 2;
+    }
+    if (resolution * 2 == this->resolutions[i]) {
+      resolution = this->resolutions[i];
+    }
+    resolutions[i] = resolution;
+  }
+
+  // Halve the largest faces until they all fit, the least important of them
+  // first.
+  GLuint atlasSize = this->atlas.size();
+  size_t area = 0;
+  for (GLuint resolution : resolutions) {
+    area += (size_t)resolution * resolution * 6;
+  }
+  while (area > (size_t)atlasSize * atlasSize) {
+    GLuint largest = 0;
+    for (GLuint i = 1; i < resolutions.size(); i++) {
+      if (resolutions[i] > resolutions[largest] ||
+          (resolutions[i] == resolutions[largest] &&
+           this->importances[i] < this->importances[largest])) {
+        largest = i;
+      }
+    }
+    if (resolutions[largest] == minResolution) {
+      break;
+    }
+    area -= (size_t)resolutions[largest] * resolutions[largest] * 6 * 3 / 4;
+    resolutions[largest] /= 2;
+  }
+
+  if (resolutions == this->resolutions) {
+    return;
+  }
+
+  // Fitting the area should be enough for the packing, but if it still fails
+  // keep halving the largest faces. Once everything is down to the minimum the
+  // least important lights lose their shadows, they get an empty tile and are
+  // never rendered.
+  std::vector<ShadowTile> tiles;
+  while (true) {
+    std::vector<GLuint> sizes;
+    for (GLuint resolution : resolutions) {
+      sizes.insert(sizes.end(), 6, resolution);
+    }
+    if (this->atlas.pack(sizes, tiles)) {
+      break;
+    }
+
+    GLuint largest = 0;
+    for (GLuint i = 1; i < resolutions.size(); i++) {
+      if (resolutions[i] > resolutions[largest] ||
+          (resolutions[i] == resolutions[largest] &&
+           this->importances[i] < this->importances[largest])) {
+        largest = i;
+      }
+    }
+    if (resolutions[largest] > minResolution) {
+      resolutions[largest] /= 2;
+      continue;
+    }
+
+    if (!this->overflowReported) {
+      std::cerr << "ERROR: Point light shadows don't fit the " << atlasSize <<
+        " texel atlas, dropping the least important ones" << std::endl;
+      this->overflowReported = true;
+    }
+    GLuint dropped = largest;
+    for (GLuint i = 0; i < resolutions.size(); i++) {
+      if (resolutions[i] > 0 &&
+          this->importances[i] < this->importances[dropped]) {
+        dropped = i;
+      }
+    }
+    resolutions[dropped] = 0;
+  }
+  this->resolutions = resolutions;
+
+  // Lights whose tiles moved have to be rendered before their shadows can be
+  // used again.
+  for (GLuint i = 0; i < this->lights.size(); i++) {
+    for (GLuint face = 0; face < 6; face++) {
+      const ShadowTile& tile = tiles[i * 6 + face];
+      if (i * 6 + face >= this->tiles.size() ||
+          tile.x != this->tiles[i * 6 + face].x ||
+          tile.y != this->tiles[i * 6 + face].y ||
+          tile.size != this->tiles[i * 6 + face].size) {
+        this->dirty[i] = true;
+        this->rendered[i] = false;
+      }
+    }
+  }
+  this->tiles = tiles;
+}
+
+void PointShadows::invalidate() {
+  std::fill(this->dirty.begin(), this->dirty.end(), true);
+}
+
+bool PointShadows::begin(const Shader& shader) {
+  // Lights without any shadows go first, then the rest by importance times
+  // the frames they've waited so every light gets its turn eventually.
+  std::vector<GLuint> candidates;
+  for (GLuint i = 0; i < this->lights.size(); i++) {
+    if (this->dirty[i] && this->resolutions[i] > 0) {
+      candidates.push_back(i);
+    }
+  }
+  std::sort(candidates.begin(), candidates.end(), [&](GLuint a, GLuint b) {
+      if (this->rendered[a] != this->rendered[b]) {
+        return !this->rendered[a];
+      }
+      return this->importances[a] * (this->waits[a] + 1) >
+        this->importances[b] * (this->waits[b] + 1);
+  });
+
+  this->scheduled.clear();
+  for (GLuint i = 0; i < candidates.size(); i++) {
+    if (i < this->updateBudget) {
+      this->scheduled.push_back(candidates[i]);
+    } else {
+      this->waits[candidates[i]]++;
+    }
+  }
+  if (this->scheduled.empty()) {
+    return false;
+  }
+
+  this->atlas.begin();
+  GLfloat atlasSize = this->atlas.size();
+  for (GLuint i = 0; i < this->scheduled.size(); i++) {
+    GLuint light = this->scheduled[i];
+    glm::vec3 position(this->lights[light]);
+    glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f,
+        kFaceNear, this->lights[light].w);
+
+    for (GLuint face = 0; face < 6; face++) {
+      glm::mat4 view = glm::lookAt(position, position + kFaceDirections[face],
+          kFaceUps[face]);
+      std::string name = "faceMatrices[" + std::to_string(i * 6 + face) + "]";
+      glUniformMatrix4fv(glGetUniformLocation(shader.program, name.c_str()), 1,
+          GL_FALSE, glm::value_ptr(projection * view));
+
+      // Center of the tile in normalized device coordinates, and its size
+      // relative to the atlas.
+      const ShadowTile& tile = this->tiles[light * 6 + face];
+      this->atlas.clear(tile);
+      name = "tiles[" + std::to_string(i * 6 + face) + "]";
+      glUniform3f(glGetUniformLocation(shader.program, name.c_str()),
+          (tile.x + tile.size * 0.5f) / atlasSize * 2.0f - 1.0f,
+          (tile.y + tile.size * 0.5f) / atlasSize * 2.0f - 1.0f,
+          tile.size / atlasSize);
+    }
+
+    std::string name = "lights[" + std::to_string(i) + "]";
+    glUniform4fv(glGetUniformLocation(shader.program, name.c_str()), 1,
+        glm::value_ptr(this->lights[light]));
+
+    this->dirty[light] = false;
+    this->rendered[light] = true;
+    this->waits[light] = 0;
+  }
+
+  // The geometry shader clips the triangles to the face they are copied into
+  // so they don't spill into the neighbouring tiles.
+  for (GLuint i = 0; i < 4; i++) {
+    glEnable(GL_CLIP_DISTANCE0 + i);
+  }
+
+  return true;
+}
+
+void PointShadows::end() {
+  for (GLuint i = 0; i < 4; i++) {
+    glDisable(GL_CLIP_DISTANCE0 + i);
+  }
+}
+
+GLuint PointShadows::faceMask(glm::vec3 center, GLfloat radius) const {
+  GLuint mask = 0;
+  for (GLuint i = 0; i < this->scheduled.size(); i++) {
+    glm::vec4 light = this->lights[this->scheduled[i]];
+    glm::vec3 toCaster = center - glm::vec3(light);
+    if (glm::length(toCaster) - radius >= light.w) {
+      continue;
+    }
+
+    // A face frustum is bounded by four planes through the light at 45
+    // degrees between its direction and its right and up vectors.
+    for (GLuint face = 0; face < 6; face++) {
+      glm::vec3 direction = kFaceDirections[face];
+      glm::vec3 up = kFaceUps[face];
+      glm::vec3 right = glm::cross(direction, up);
+      GLfloat forward = glm::dot(toCaster, direction);
+      GLfloat across = fabsf(glm::dot(toCaster, right));
+      GLfloat along = fabsf(glm::dot(toCaster, up));
+      GLfloat margin = radius * sqrtf(2.0f);
+      if (forward - across > -margin && forward - along > -margin) {
+        mask |= 1u << (i * 6 + face);
+      }
+    }
+  }
+
+  return mask;
+}
+
+void PointShadows::bind(const Shader& shader, GLuint unit) {
+  this->atlas.bind(unit);
+  glUniform1i(glGetUniformLocation(shader.program, "pointShadowMap"), unit);
+  glUniform1i(glGetUniformLocation(shader.program, "pointLightCount"),
+      this->lights.size());
+
+  // Lights that were never rendered into their tiles get an empty tile and
+  // no shadows.
+  GLfloat atlasSize = this->atlas.size();
+  for (GLuint i = 0; i < this->lights.size(); i++) {
+    std::string name = "pointLights[" + std::to_string(i) + "]";
+    glUniform4fv(glGetUniformLocation(shader.program, name.c_str()), 1,
+        glm::value_ptr(this->lights[i]));
+
+    for (GLuint face = 0; face < 6; face++) {
+      const ShadowTile& tile = this->tiles[i * 6 + face];
+      GLfloat size = this->rendered[i] && this->resolutions[i] > 0 ?
+        tile.size / atlasSize : 0.0f;
+      name = "pointShadowTiles[" + std::to_string(i * 6 + face) + "]";
+      glUniform3f(glGetUniformLocation(shader.program, name.c_str()),
+          tile.x / atlasSize, tile.y / atlasSize, size);
+    }
+  }
+}
+
+size_t PointShadows::bytes() const {
+  return this->atlas.bytes();
+}
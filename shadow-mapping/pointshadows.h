@@ -0,0 +1,114 @@
+#ifndef POINTSHADOWS_H
+#define POINTSHADOWS_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+extern "C" {
+#include <GL/glew.h>
+}
+
+#include "perspectivecamera.h"
+#include "shader.h"
+#include "shadowatlas.h"
+
+// Most point lights with shadows the shaders have room for (MAX_POINT_LIGHTS
+// in glsl/fragment.glsl).
+const GLuint kMaxPointLights = 16;
+
+// Most point lights whose shadows are rendered in a single pass
+// (MAX_POINT_SHADOWS in glsl/cube_depth_*.glsl). Their faces have to fit in
+// the bits of a face mask and in the output of one geometry shader
+// invocation.
+const GLuint kMaxPointShadows = 4;
+
+// Omnidirectional shadows for point lights. Every light gets six square tiles
+// of a shadow atlas, one per cube face, holding the distance to the light
+// over its radius. The shaders pick the face and its tile themselves.
+//
+// The tiles are sized by how large the light appears on screen, and updates
+// are time-sliced: at most a budgeted number of dirty lights are rendered per
+// frame, the ones that are largest on screen and have waited the longest
+// first. The cost of the shadows doesn't grow with the number of lights,
+// distant and off screen lights just catch up more slowly.
+//
+// All the faces of the lights picked are rendered in a single pass. The
+// geometry shader copies every triangle into the tiles of the faces in the
+// face mask of its caster, which only holds the faces the caster's bounds
+// overlap.
+class PointShadows {
+  public:
+    // Allocates a shadow atlas atlasSize texels wide. Faces get between
+    // minResolution and maxResolution texels (powers of two), the atlas has
+    // to fit the faces of kMaxPointLights lights at minResolution. At most
+    // updateBudget lights (up to kMaxPointShadows) are rendered per frame.
+    PointShadows(GLuint atlasSize, GLuint minResolution, GLuint maxResolution,
+        GLuint updateBudget);
+
+    PointShadows(const PointShadows&) = delete;
+    PointShadows& operator=(const PointShadows&) = delete;
+
+    // Whether the shadow atlas could be rendered into and the geometry shader
+    // can output every face of a pass.
+    bool complete();
+
+    // Sets the lights as spheres (position and radius) reaching as far as
+    // their shadows, and sizes their tiles by how large they are seen from
+    // the camera. The shadows of a light become dirty if it changed or its
+    // tiles moved.
+    void update(const std::vector<glm::vec4>& lights,
+        const PerspectiveCamera& camera);
+
+    // Marks the shadows of every light dirty, for when a caster moved.
+    void invalidate();
+
+    // Returns whether any lights are rendered this frame. If so the atlas is
+    // bound as the framebuffer, the tiles of the lights are cleared, and
+    // their face matrices, tiles and positions are passed to the shader
+    // (glsl/cube_depth_*.glsl), which must be in use. end has to be called
+    // after drawing the casters.
+    bool begin(const Shader& shader);
+    void end();
+
+    // Faces of the lights rendered this frame overlapped by a caster inside
+    // the bounding sphere, bit 6 * light + face is set for every one of them.
+    // Passed to the shader as faceMask before drawing the caster, nothing
+    // needs to be drawn when it is 0.
+    GLuint faceMask(glm::vec3 center, GLfloat radius) const;
+
+    // Binds the shadow atlas to the given unit and passes the lights and
+    // their tiles to the shader, which must be in use.
+    void bind(const Shader& shader, GLuint unit);
+
+    // Size of the shadow atlas in bytes.
+    size_t bytes() const;
+  private:
+    ShadowAtlas atlas;
+    GLuint maxResolution;
+    GLuint updateBudget;
+
+    std::vector<glm::vec4> lights;
+
+    // Per light how large it is on screen (0 to 1), the size of its faces
+    // (0 when it didn't fit the atlas) and its six tiles.
+    std::vector<GLfloat> importances;
+    std::vector<GLuint> resolutions;
+    std::vector<ShadowTile> tiles;
+
+    // Per light whether its shadows are out of date, whether its tiles hold
+    // its shadows at all, and for how many frames it has been dirty.
+    std::vector<bool> dirty;
+    std::vector<bool> rendered;
+    std::vector<GLuint> waits;
+
+    // Lights rendered this frame, in the order of the face mask.
+    std::vector<GLuint> scheduled;
+
+    // Whether running out of atlas space was reported already.
+    bool overflowReported;
+
+    void resize();
+};
+
+#endif
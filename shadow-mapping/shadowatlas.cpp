@@ -0,0 +1,114 @@
+#include "shadowatlas.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace {
+
+// Every other bit of a Morton code, the x or y coordinate it interleaves.
+GLuint compactBits(GLuint code) {
+  code &= 0x55555555;
+  code = (code | (code >> 1)) & 0x33333333;
+  code = (code | (code >> 2)) & 0x0f0f0f0f;
+  code = (code | (code >> 4)) & 0x00ff00ff;
+  code = (code | (code >> 8)) & 0x0000ffff;
+  return code;
+}
+
+}
+
+ShadowAtlas::ShadowAtlas(GLuint size, GLuint minTileSize) : atlasSize(size),
+    tileSize(minTileSize) {
+  // The distance is written as the depth and compared by hand in the shader.
+  glGenTextures(1, &this->texture);
+  glBindTexture(GL_TEXTURE_2D, this->texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, size, size, 0,
+      GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glGenFramebuffers(1, &this->framebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D,
+      this->texture, 0);
+  glDrawBuffer(GL_NONE);
+  glReadBuffer(GL_NONE);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+ShadowAtlas::~ShadowAtlas() {
+  glDeleteFramebuffers(1, &this->framebuffer);
+  glDeleteTextures(1, &this->texture);
+}
+
+bool ShadowAtlas::complete() {
+  glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+  bool complete =
+    glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  return complete;
+}
+
+bool ShadowAtlas::pack(const std::vector<GLuint>& sizes,
+    std::vector<ShadowTile>& tiles) const {
+  // Largest first, ties in the order given.
+  std::vector<GLuint> order(sizes.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](GLuint a, GLuint b) {
+      return sizes[a] > sizes[b];
+  });
+
+  // Walk the minimum size tiles along a Z-order curve. A power of two tile
+  // covers a run of the curve as long as the run starts at a multiple of its
+  // length, which placing the largest tiles first guarantees. Nothing is left
+  // unused between the tiles either.
+  GLuint cells = this->atlasSize / this->tileSize;
+  GLuint cursor = 0;
+  tiles.resize(sizes.size());
+  for (GLuint i : order) {
+    GLuint span = sizes[i] / this->tileSize;
+    if (cursor + span * span > cells * cells) {
+      return false;
+    }
+    tiles[i].x = compactBits(cursor) * this->tileSize;
+    tiles[i].y = compactBits(cursor >> 1) * this->tileSize;
+    tiles[i].size = sizes[i];
+    cursor += span * span;
+  }
+
+  return true;
+}
+
+void ShadowAtlas::begin() {
+  glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+  glViewport(0, 0, this->atlasSize, this->atlasSize);
+}
+
+void ShadowAtlas::clear(const ShadowTile& tile) {
+  glEnable(GL_SCISSOR_TEST);
+  glScissor(tile.x, tile.y, tile.size, tile.size);
+  glClear(GL_DEPTH_BUFFER_BIT);
+  glDisable(GL_SCISSOR_TEST);
+}
+
+void ShadowAtlas::bind(GLuint unit) {
+  glActiveTexture(GL_TEXTURE0 + unit);
+  glBindTexture(GL_TEXTURE_2D, this->texture);
+}
+
+GLuint ShadowAtlas::size() const {
+  return this->atlasSize;
+}
+
+GLuint ShadowAtlas::minTileSize() const {
+  return this->tileSize;
+}
+
+size_t ShadowAtlas::bytes() const {
+  // Drivers store 24-bit depth in 32 bits.
+  return (size_t)this->atlasSize * this->atlasSize * 4;
+}
@@ -0,0 +1,64 @@
+#ifndef SHADOWATLAS_H
+#define SHADOWATLAS_H
+
+#include <cstddef>
+#include <vector>
+
+extern "C" {
+#include <GL/glew.h>
+}
+
+// A square region of the atlas, in texels.
+struct ShadowTile {
+  GLuint x;
+  GLuint y;
+  GLuint size;
+};
+
+// One large depth texture shared by many shadow maps, each rendered into a
+// square tile of it. The tile sizes are powers of two and can change every
+// time the tiles are packed, so shadows can be given more or fewer texels as
+// they become more or less important without allocating anything.
+class ShadowAtlas {
+  public:
+    // Allocates a size by size depth texture. Tiles are at least minTileSize
+    // texels wide, both have to be powers of two.
+    ShadowAtlas(GLuint size, GLuint minTileSize);
+    ~ShadowAtlas();
+
+    ShadowAtlas(const ShadowAtlas&) = delete;
+    ShadowAtlas& operator=(const ShadowAtlas&) = delete;
+
+    // Whether the depth texture could be rendered into.
+    bool complete();
+
+    // Places tiles of the given sizes, powers of two between the minimum tile
+    // size and the atlas size, without overlap. A tile keeps its place as
+    // long as the tiles packed before it (the larger ones, then the earlier
+    // ones of its size) keep theirs. Returns false when they don't fit.
+    bool pack(const std::vector<GLuint>& sizes,
+        std::vector<ShadowTile>& tiles) const;
+
+    // Binds the atlas as the framebuffer with a viewport covering all of it.
+    void begin();
+
+    // Clears the depth of a single tile, the atlas has to be bound.
+    void clear(const ShadowTile& tile);
+
+    // Binds the depth texture to the given unit.
+    void bind(GLuint unit);
+
+    GLuint size() const;
+    GLuint minTileSize() const;
+
+    // Size of the depth texture in bytes.
+    size_t bytes() const;
+  private:
+    GLuint atlasSize;
+    GLuint tileSize;
+
+    GLuint framebuffer;
+    GLuint texture;
+};
+
+#endif
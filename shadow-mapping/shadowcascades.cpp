@@ -0,0 +1,492 @@
+#include "shadowcascades.h"
+
+#include <algorithm>
+#include <math.h>
+#include <numeric>
+#include <string>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+namespace {
+
+// Casters up to this far towards the light from a cascade still shadow it,
+// even though they are outside of the camera frustum.
+const GLfloat kCasterDistance = 20.0f;
+
+// Radii are rounded up to this step so their texel size only changes with
+// the field of view and not with tiny floating point differences.
+const GLfloat kRadiusStep = 1.0f / 16.0f;
+
+// Places square tiles of the given sizes in columns of the given height,
+// largest first. A column is as wide as its first tile and filled with rows
+// of tiles. Returns the width of the columns together.
+GLuint packColumns(const std::vector<GLuint>& sizes, GLuint height,
+    std::vector<ShadowTile>& tiles) {
+  std::vector<GLuint> order(sizes.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](GLuint a, GLuint b) {
+      return sizes[a] > sizes[b];
+  });
+
+  GLuint columnX = 0, columnWidth = 0;
+  GLuint rowX = 0, rowY = 0, rowHeight = 0;
+  tiles.resize(sizes.size());
+  for (GLuint i : order) {
+    GLuint size = sizes[i];
+    if (columnWidth == 0 ||
+        (rowX + size > columnWidth && rowY + rowHeight + size > height)) {
+      columnX += columnWidth;
+      columnWidth = size;
+      rowX = rowY = 0;
+      rowHeight = size;
+    } else if (rowX + size > columnWidth) {
+      rowY += rowHeight;
+      rowX = 0;
+      rowHeight = size;
+    }
+    tiles[i].x = columnX + rowX;
+    tiles[i].y = rowY;
+    tiles[i].size = size;
+    rowX += size;
+  }
+  return columnX + columnWidth;
+}
+
+}
+
+ShadowCascades::ShadowCascades(const std::vector<GLuint>& resolutions,
+    GLfloat shadowDistance, GLfloat lambda) : resolutions(resolutions),
+    atlasWidth(0), atlasHeight(0), shadowDistance(shadowDistance),
+    lambda(lambda), composited(false), filter(ShadowFilter::PCF),
+    exponentialTextures(), exponentialFramebuffers(), blurVAO(0),
+    matrices(resolutions.size()),
+    splits(resolutions.size()), texelSizes(resolutions.size()),
+    depthRanges(resolutions.size()), boxes(resolutions.size()),
+    receiverCulling(false), receiverPlanes(resolutions.size() * 6),
+    dirty(resolutions.size(), true), unfiltered(resolutions.size(), true) {
+  // Pack the cascades into columns as tall as the largest one, making the
+  // columns taller while the atlas comes out more than twice as wide.
+  for (GLuint resolution : resolutions) {
+    this->atlasHeight = std::max(this->atlasHeight, resolution);
+  }
+  this->atlasWidth = packColumns(resolutions, this->atlasHeight, this->tiles);
+  while (this->atlasWidth > this->atlasHeight * 2) {
+    this->atlasHeight *= 2;
+    this->atlasWidth = packColumns(resolutions, this->atlasHeight,
+        this->tiles);
+  }
+
+  // Depth comparisons are done by hand in the shader for PCF, so the depth
+  // is read as is.
+  glGenTextures(2, this->textures);
+  glGenFramebuffers(2, this->framebuffers);
+  for (GLuint i = 0; i < 2; i++) {
+    glBindTexture(GL_TEXTURE_2D, this->textures[i]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, this->atlasWidth,
+        this->atlasHeight, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffers[i]);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D,
+        this->textures[i], 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  // The same depth read through a sampler object that compares it against
+  // the reference depth and filters the results.
+  glGenSamplers(1, &this->compareSampler);
+  glSamplerParameteri(this->compareSampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glSamplerParameteri(this->compareSampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glSamplerParameteri(this->compareSampler, GL_TEXTURE_WRAP_S,
+      GL_CLAMP_TO_EDGE);
+  glSamplerParameteri(this->compareSampler, GL_TEXTURE_WRAP_T,
+      GL_CLAMP_TO_EDGE);
+  glSamplerParameteri(this->compareSampler, GL_TEXTURE_COMPARE_MODE,
+      GL_COMPARE_REF_TO_TEXTURE);
+  glSamplerParameteri(this->compareSampler, GL_TEXTURE_COMPARE_FUNC,
+      GL_LEQUAL);
+}
+
+ShadowCascades::~ShadowCascades() {
+  glDeleteFramebuffers(2, this->framebuffers);
+  glDeleteTextures(2, this->textures);
+  glDeleteSamplers(1, &this->compareSampler);
+
+  // Zero names are ignored when the exponential maps were never used.
+  glDeleteFramebuffers(2, this->exponentialFramebuffers);
+  glDeleteTextures(2, this->exponentialTextures);
+  glDeleteVertexArrays(1, &this->blurVAO);
+}
+
+bool ShadowCascades::complete() {
+  bool complete = true;
+  for (GLuint i = 0; i < 2; i++) {
+    glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffers[i]);
+    complete = complete &&
+      glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  return complete;
+}
+
+void ShadowCascades::update(const PerspectiveCamera& camera,
+    glm::vec3 direction) {
+  const GLuint count = this->resolutions.size();
+  const GLfloat near = camera.near;
+  const GLfloat far = std::min(camera.far, this->shadowDistance);
+
+  // Camera basis to build the frustum corners from.
+  const glm::vec3 right = glm::normalize(glm::cross(camera.front, camera.up));
+  const glm::vec3 up = glm::cross(right, camera.front);
+  const GLfloat tanHalfFov = tanf(camera.fov * 0.5f);
+
+  // The light looks along direction from the origin. Every cascade shares
+  // this orientation so their texel grids stay fixed in the world.
+  this->direction = glm::normalize(direction);
+  glm::vec3 lightUp = fabsf(this->direction.y) > 0.99f ?
+    glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+  this->lightView = glm::lookAt(glm::vec3(0.0f), this->direction, lightUp);
+
+  this->composited = false;
+
+  GLfloat splitNear = near;
+  for (GLuint i = 0; i < count; i++) {
+    // Practical split scheme, logarithmic splits keep the texel to pixel
+    // ratio even but leave the nearest cascade tiny, uniform ones the
+    // opposite.
+    GLfloat ratio = (GLfloat)(i + 1) / count;
+    GLfloat logSplit = near * powf(far / near, ratio);
+    GLfloat uniformSplit = near + (far - near) * ratio;
+    GLfloat splitFar = this->lambda * logSplit +
+      (1.0f - this->lambda) * uniformSplit;
+
+    // Bound the corners of the split with a sphere. Unlike a box fitted to
+    // the corners its size doesn't change as the camera turns, which would
+    // make the shadow edges crawl.
+    glm::vec3 corners[8];
+    GLfloat depths[2] = { splitNear, splitFar };
+    glm::vec3 center(0.0f);
+    for (GLuint j = 0; j < 8; j++) {
+      GLfloat depth = depths[j / 4];
+      GLfloat halfHeight = depth * tanHalfFov;
+      GLfloat halfWidth = halfHeight * camera.aspect;
+      corners[j] = camera.position + camera.front * depth +
+        right * (j % 2 == 0 ? -halfWidth : halfWidth) +
+        up * ((j / 2) % 2 == 0 ? -halfHeight : halfHeight);
+      center += corners[j] / 8.0f;
+    }
+    GLfloat radius = 0.0f;
+    for (GLuint j = 0; j < 8; j++) {
+      radius = std::max(radius, glm::length(corners[j] - center));
+    }
+    radius = ceilf(radius / kRadiusStep) * kRadiusStep;
+
+    // Snap the center to whole texels in light space so the shadow map only
+    // ever moves by whole texels and doesn't shimmer.
+    GLfloat texelSize = 2.0f * radius / this->resolutions[i];
+    glm::vec4 lightCenter = this->lightView * glm::vec4(center, 1.0f);
+    lightCenter.x = floorf(lightCenter.x / texelSize) * texelSize;
+    lightCenter.y = floorf(lightCenter.y / texelSize) * texelSize;
+
+    GLfloat nearPlane = -lightCenter.z - radius - kCasterDistance;
+    GLfloat farPlane = -lightCenter.z + radius;
+    glm::mat4 projection = glm::ortho(lightCenter.x - radius,
+        lightCenter.x + radius, lightCenter.y - radius,
+        lightCenter.y + radius, nearPlane, farPlane);
+
+    // The cached depth only holds up for the exact same projection. Thanks to
+    // the snapping a still camera and light produce bit identical matrices.
+    glm::mat4 matrix = projection * this->lightView;
+    if (matrix != this->matrices[i]) {
+      this->dirty[i] = true;
+    }
+    this->matrices[i] = matrix;
+    this->boxes[i] = glm::vec4(lightCenter.x, lightCenter.y, radius,
+        farPlane);
+
+    // The slice planes move with the camera even when the snapped projection
+    // doesn't, and with them the casters that pass the receiver test.
+    static const GLuint planeCorners[6][3] = {
+      { 0, 1, 2 }, { 4, 5, 6 }, { 0, 2, 4 }, { 1, 3, 5 }, { 0, 1, 4 },
+      { 2, 3, 6 }
+    };
+    for (GLuint j = 0; j < 6; j++) {
+      glm::vec3 a = corners[planeCorners[j][0]];
+      glm::vec3 b = corners[planeCorners[j][1]];
+      glm::vec3 c = corners[planeCorners[j][2]];
+      glm::vec3 normal = glm::normalize(glm::cross(b - a, c - a));
+      if (glm::dot(normal, center - a) < 0.0f) {
+        normal = -normal;
+      }
+      glm::vec4 plane(normal, -glm::dot(normal, a));
+      glm::vec4& receiverPlane = this->receiverPlanes[i * 6 + j];
+      if (this->receiverCulling && plane != receiverPlane) {
+        this->dirty[i] = true;
+      }
+      receiverPlane = plane;
+    }
+    this->splits[i] = splitFar;
+    this->texelSizes[i] = texelSize;
+    this->depthRanges[i] = farPlane - nearPlane;
+    splitNear = splitFar;
+  }
+}
+
+void ShadowCascades::invalidate() {
+  std::fill(this->dirty.begin(), this->dirty.end(), true);
+}
+
+bool ShadowCascades::castsShadow(GLuint cascade, glm::vec3 center,
+    GLfloat radius) const {
+  if (2.0f * radius < kMinCasterTexels * this->texelSizes[cascade]) {
+    return false;
+  }
+
+  // The light projection is a box in light space. Casters past its sides or
+  // behind its far plane can't be seen by the light, the near plane already
+  // lies far enough towards the light to not cull anything visible.
+  const glm::vec4& box = this->boxes[cascade];
+  glm::vec4 lightCenter = this->lightView * glm::vec4(center, 1.0f);
+  GLfloat depth = -lightCenter.z;
+  if (fabsf(lightCenter.x - box.x) > box.z + radius ||
+      fabsf(lightCenter.y - box.y) > box.z + radius ||
+      depth - radius > box.w) {
+    return false;
+  }
+
+  if (!this->receiverCulling) {
+    return true;
+  }
+
+  // Sweep the caster along the light up to the far plane, which is as far as
+  // the shadow can fall. It only matters if some of that reaches the slice,
+  // checked conservatively one plane at a time.
+  glm::vec3 end = center + this->direction * std::max(box.w - depth, 0.0f);
+  for (GLuint j = 0; j < 6; j++) {
+    const glm::vec4& plane = this->receiverPlanes[cascade * 6 + j];
+    glm::vec3 normal(plane);
+    if (glm::dot(normal, center) + plane.w < -radius &&
+        glm::dot(normal, end) + plane.w < -radius) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void ShadowCascades::setReceiverCulling(bool enabled) {
+  if (enabled != this->receiverCulling) {
+    this->receiverCulling = enabled;
+    invalidate();
+  }
+}
+
+bool ShadowCascades::beginStatic(GLuint cascade, const Shader& shader) {
+  if (!this->dirty[cascade]) {
+    return false;
+  }
+  this->dirty[cascade] = false;
+
+  this->unfiltered[cascade] = true;
+
+  // Only the tile of the cascade is cleared, the others keep their depth.
+  const ShadowTile& tile = this->tiles[cascade];
+  bindCascade(this->framebuffers[0], cascade, shader);
+  glEnable(GL_SCISSOR_TEST);
+  glScissor(tile.x, tile.y, tile.size, tile.size);
+  glClear(GL_DEPTH_BUFFER_BIT);
+  glDisable(GL_SCISSOR_TEST);
+  return true;
+}
+
+void ShadowCascades::beginDynamic(GLuint cascade, const Shader& shader) {
+  this->composited = true;
+  this->unfiltered[cascade] = true;
+
+  const ShadowTile& tile = this->tiles[cascade];
+  GLint x0 = tile.x, y0 = tile.y;
+  GLint x1 = tile.x + tile.size, y1 = tile.y + tile.size;
+  bindCascade(this->framebuffers[1], cascade, shader);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, this->framebuffers[0]);
+  glBlitFramebuffer(x0, y0, x1, y1, x0, y0, x1, y1, GL_DEPTH_BUFFER_BIT,
+      GL_NEAREST);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, this->framebuffers[1]);
+}
+
+void ShadowCascades::setFilter(ShadowFilter filter) {
+  if (filter == this->filter) {
+    return;
+  }
+  this->filter = filter;
+
+  // The exponential maps weren't kept up to date with the other filters.
+  if (filter == ShadowFilter::Exponential) {
+    if (this->blurVAO == 0) {
+      createExponentialMaps();
+    }
+    std::fill(this->unfiltered.begin(), this->unfiltered.end(), true);
+  }
+}
+
+void ShadowCascades::prefilter() {
+  if (this->filter != ShadowFilter::Exponential) {
+    return;
+  }
+
+  GLuint depth = this->textures[this->composited ? 1 : 0];
+  glBindVertexArray(this->blurVAO);
+  glDisable(GL_DEPTH_TEST);
+  glActiveTexture(GL_TEXTURE0);
+
+  for (GLuint i = 0; i < this->count(); i++) {
+    if (!this->unfiltered[i]) {
+      continue;
+    }
+    this->unfiltered[i] = false;
+    const ShadowTile& tile = this->tiles[i];
+
+    // Horizontally from the depth of the cascade into the corner of the
+    // intermediate texture, turning depth into exponential depth on the way.
+    this->exponentialShader.use();
+    glBindFramebuffer(GL_FRAMEBUFFER, this->exponentialFramebuffers[1]);
+    glViewport(0, 0, tile.size, tile.size);
+    glBindTexture(GL_TEXTURE_2D, depth);
+    glUniform1i(glGetUniformLocation(this->exponentialShader.program,
+          "depthMap"), 0);
+    glUniform3i(glGetUniformLocation(this->exponentialShader.program,
+          "tile"), tile.x, tile.y, tile.size);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    // Then vertically into the tile of the cascade.
+    this->blurShader.use();
+    glBindFramebuffer(GL_FRAMEBUFFER, this->exponentialFramebuffers[0]);
+    glViewport(tile.x, tile.y, tile.size, tile.size);
+    glBindTexture(GL_TEXTURE_2D, this->exponentialTextures[1]);
+    glUniform1i(glGetUniformLocation(this->blurShader.program, "source"), 0);
+    glUniform3i(glGetUniformLocation(this->blurShader.program, "tile"),
+        tile.x, tile.y, tile.size);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+  }
+
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glBindVertexArray(0);
+  glEnable(GL_DEPTH_TEST);
+}
+
+void ShadowCascades::bind(const Shader& shader, GLuint unit) {
+  GLuint depth = this->textures[this->composited ? 1 : 0];
+  glActiveTexture(GL_TEXTURE0 + unit);
+  glBindTexture(GL_TEXTURE_2D, depth);
+  glUniform1i(glGetUniformLocation(shader.program, "shadowMap"), unit);
+
+  // Samplers of different types can't share a unit even when unused, so the
+  // comparison sampler and exponential maps always get their own.
+  glActiveTexture(GL_TEXTURE0 + unit + 1);
+  glBindTexture(GL_TEXTURE_2D, depth);
+  glBindSampler(unit + 1, this->compareSampler);
+  glUniform1i(glGetUniformLocation(shader.program, "shadowMapCompare"),
+      unit + 1);
+  glActiveTexture(GL_TEXTURE0 + unit + 2);
+  glBindTexture(GL_TEXTURE_2D, this->exponentialTextures[0]);
+  glUniform1i(glGetUniformLocation(shader.program, "shadowMapExponential"),
+      unit + 2);
+  glUniform1i(glGetUniformLocation(shader.program, "shadowFilter"),
+      (GLint)this->filter);
+  glUniform1i(glGetUniformLocation(shader.program, "cascadeCount"),
+      this->count());
+
+  for (GLuint i = 0; i < this->count(); i++) {
+    std::string index = "[" + std::to_string(i) + "]";
+    const ShadowTile& tile = this->tiles[i];
+    glUniformMatrix4fv(glGetUniformLocation(shader.program,
+          ("cascadeMatrices" + index).c_str()), 1, GL_FALSE,
+        glm::value_ptr(this->matrices[i]));
+    glUniform3f(glGetUniformLocation(shader.program,
+          ("cascades" + index).c_str()), this->splits[i],
+        this->texelSizes[i], this->depthRanges[i]);
+    glUniform4f(glGetUniformLocation(shader.program,
+          ("cascadeTiles" + index).c_str()),
+        (GLfloat)tile.x / this->atlasWidth,
+        (GLfloat)tile.y / this->atlasHeight,
+        (GLfloat)tile.size / this->atlasWidth,
+        (GLfloat)tile.size / this->atlasHeight);
+  }
+}
+
+GLuint ShadowCascades::count() const {
+  return this->resolutions.size();
+}
+
+size_t ShadowCascades::bytes() const {
+  // Drivers store 24-bit depth in 32 bits. The exponential maps are another
+  // 32-bit atlas and the intermediate texture as large as the largest
+  // cascade.
+  size_t atlas = (size_t)this->atlasWidth * this->atlasHeight * 4;
+  size_t bytes = atlas * 2;
+  if (this->blurVAO != 0) {
+    GLuint largest = this->tiles[0].size;
+    for (const ShadowTile& tile : this->tiles) {
+      largest = std::max(largest, tile.size);
+    }
+    bytes += atlas + (size_t)largest * largest * 4;
+  }
+  return bytes;
+}
+
+void ShadowCascades::createExponentialMaps() {
+  glGenTextures(2, this->exponentialTextures);
+  glGenFramebuffers(2, this->exponentialFramebuffers);
+
+  // Filtered bilinearly when sampled, that is the point of prefiltering.
+  glBindTexture(GL_TEXTURE_2D, this->exponentialTextures[0]);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, this->atlasWidth,
+      this->atlasHeight, 0, GL_RED, GL_FLOAT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+  // The blur passes go through it one cascade at a time.
+  GLuint largest = 0;
+  for (const ShadowTile& tile : this->tiles) {
+    largest = std::max(largest, tile.size);
+  }
+  glBindTexture(GL_TEXTURE_2D, this->exponentialTextures[1]);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, largest, largest, 0, GL_RED,
+      GL_FLOAT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, this->exponentialFramebuffers[0]);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+      this->exponentialTextures[0], 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, this->exponentialFramebuffers[1]);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+      this->exponentialTextures[1], 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  this->exponentialShader = Shader("glsl/shadow_blur_vert.glsl",
+      "glsl/shadow_exp_frag.glsl");
+  this->blurShader = Shader("glsl/shadow_blur_vert.glsl",
+      "glsl/shadow_blur_frag.glsl");
+  glGenVertexArrays(1, &this->blurVAO);
+}
+
+void ShadowCascades::bindCascade(GLuint framebuffer, GLuint cascade,
+    const Shader& shader) {
+  const ShadowTile& tile = this->tiles[cascade];
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glViewport(tile.x, tile.y, tile.size, tile.size);
+
+  glUniformMatrix4fv(glGetUniformLocation(shader.program, "lightSpaceMatrix"),
+      1, GL_FALSE, glm::value_ptr(this->matrices[cascade]));
+}
@@ -0,0 +1,176 @@
+#ifndef SHADOWCASCADES_H
+#define SHADOWCASCADES_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+extern "C" {
+#include <GL/glew.h>
+}
+
+#include "perspectivecamera.h"
+#include "shader.h"
+#include "shadowatlas.h"
+
+// Most cascades the shaders have room for (MAX_CASCADES in
+// glsl/fragment.glsl).
+const GLuint kMaxShadowCascades = 8;
+
+// Casters narrower than this many texels of a cascade are left out of it, the
+// filtered shadow they would cast is too faint to see.
+const GLfloat kMinCasterTexels = 1.0f;
+
+// How the shadow maps are filtered when sampled, the order matches the
+// SHADOW_FILTER_* defines in glsl/fragment.glsl.
+//
+//   PCF: 3x3 depth compares done by hand, 9 fetches.
+//   HardwarePCF: 4 fetches through a comparison sampler, each of which
+//     compares and blends the 4 nearest texels.
+//   Exponential: exponential shadow maps, blurred once after rendering and
+//     then sampled with a single bilinear fetch.
+enum class ShadowFilter {
+  PCF,
+  HardwarePCF,
+  Exponential
+};
+const GLuint kShadowFilterCount = 3;
+
+// Directional light shadows with cascaded shadow maps. The camera frustum is
+// split in depth and every split gets its own orthographic light projection
+// fitted around it, so near geometry gets small texels and far geometry large
+// ones instead of one fixed box for the whole scene. Every cascade is
+// rendered into a tile of its own resolution in a shared depth atlas.
+//
+// Static casters are cached: a cascade only renders them again when it is
+// dirty, that is when its projection changed (the light or camera moved) or
+// when invalidate was called because a static caster moved. Dynamic casters
+// are drawn every frame on top of a copy of the cached depth.
+class ShadowCascades {
+  public:
+    // One cascade per resolution, nearest first. The frustum is split between
+    // the camera near plane and shadowDistance, blending logarithmic and
+    // uniform splits by lambda (1 is fully logarithmic). The tiles are packed
+    // into an atlas only as large as they need.
+    ShadowCascades(const std::vector<GLuint>& resolutions,
+        GLfloat shadowDistance, GLfloat lambda);
+    ~ShadowCascades();
+
+    ShadowCascades(const ShadowCascades&) = delete;
+    ShadowCascades& operator=(const ShadowCascades&) = delete;
+
+    // Whether the depth atlases could be rendered into.
+    bool complete();
+
+    // Fits the cascades around the camera frustum for a light shining along
+    // direction. Cascades whose projection changed become dirty.
+    void update(const PerspectiveCamera& camera, glm::vec3 direction);
+
+    // Marks every cascade dirty, for when static casters were added, removed
+    // or moved.
+    void invalidate();
+
+    // Whether a caster inside the bounding sphere can cast a shadow anyone
+    // sees in a cascade. It has to overlap the light projection, cover at
+    // least kMinCasterTexels texels and, with receiver culling on, its shadow
+    // has to reach the slice of the camera frustum the cascade covers.
+    bool castsShadow(GLuint cascade, glm::vec3 center, GLfloat radius) const;
+
+    // Turns culling casters against the camera frustum slices on or off
+    // (off by default). Casters outside of the slice but inside the light
+    // projection then still get drawn.
+    void setReceiverCulling(bool enabled);
+
+    // Returns whether the static casters of a cascade have to be drawn again.
+    // If so the cached depth of the cascade is bound as the framebuffer,
+    // cleared, and the light space matrix is passed to the shader, which must
+    // be in use.
+    bool beginStatic(GLuint cascade, const Shader& shader);
+
+    // Copies the cached depth of a cascade into the map dynamic casters are
+    // drawn into and binds it like beginStatic. Has to be called for every
+    // cascade in the frames there are dynamic casters, after beginStatic.
+    void beginDynamic(GLuint cascade, const Shader& shader);
+
+    // Switches how the shadows are filtered. The exponential maps are only
+    // allocated once they are first used.
+    void setFilter(ShadowFilter filter);
+
+    // Blurs the exponential maps of the cascades whose depth changed since,
+    // does nothing unless filtering with ShadowFilter::Exponential.
+    void prefilter();
+
+    // Binds the depth atlas to the given unit and passes the cascades and
+    // their tiles to the shader, which must be in use. That is the cached
+    // depth unless dynamic casters were drawn since the last update. The
+    // comparison sampler and the exponential maps take the two units after
+    // it.
+    void bind(const Shader& shader, GLuint unit);
+
+    GLuint count() const;
+
+    // Size of the depth atlases and exponential maps in bytes.
+    size_t bytes() const;
+  private:
+    std::vector<GLuint> resolutions;
+
+    // Where every cascade is in the atlases, and their size.
+    std::vector<ShadowTile> tiles;
+    GLuint atlasWidth;
+    GLuint atlasHeight;
+
+    GLfloat shadowDistance;
+    GLfloat lambda;
+
+    // Framebuffers and depth atlases of the cached static casters and of the
+    // static and dynamic casters together.
+    GLuint framebuffers[2];
+    GLuint textures[2];
+
+    // Whether beginDynamic was called since the last update.
+    bool composited;
+
+    // Reads the depth as bilinearly filtered comparisons.
+    GLuint compareSampler;
+
+    // Exponential shadow map atlas and the intermediate texture between the
+    // two blur passes, zero until first used. Then the framebuffers to write
+    // them, the shaders for the horizontal and vertical passes and the empty
+    // vertex array their full screen triangle is drawn with.
+    ShadowFilter filter;
+    GLuint exponentialTextures[2];
+    GLuint exponentialFramebuffers[2];
+    Shader exponentialShader;
+    Shader blurShader;
+    GLuint blurVAO;
+
+    // Per cascade light space matrix, view depth its split ends at, world
+    // size of a texel and depth range of the projection.
+    std::vector<glm::mat4> matrices;
+    std::vector<GLfloat> splits;
+    std::vector<GLfloat> texelSizes;
+    std::vector<GLfloat> depthRanges;
+
+    // Shared light direction and view, and per cascade the projection box as
+    // the light space x and y of its center, its half size and the depth of
+    // its far plane.
+    glm::vec3 direction;
+    glm::mat4 lightView;
+    std::vector<glm::vec4> boxes;
+
+    // Per cascade the six planes bounding its slice of the camera frustum,
+    // pointing inwards.
+    bool receiverCulling;
+    std::vector<glm::vec4> receiverPlanes;
+
+    // Per cascade whether the cached static depth is out of date, and
+    // whether its depth changed after its exponential map was blurred.
+    std::vector<bool> dirty;
+    std::vector<bool> unfiltered;
+
+    void createExponentialMaps();
+    void bindCascade(GLuint framebuffer, GLuint cascade,
+        const Shader& shader);
+};
+
+#endif